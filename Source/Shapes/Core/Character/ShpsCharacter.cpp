@@ -2,27 +2,156 @@
 
 
 #include "ShpsCharacter.h"
+#include "Shapes/Gameplay/Selection/ShpsSelectionSubsystem.h"
+#include "Shapes/Gameplay/ShapesSpawner/ShpsSpawnerSubsystem.h"
+#include "Shapes/Gameplay/ShapesSpawner/Shapes/ShpsBaseShape.h"
+#include "Shapes/Gameplay/Projectiles/ShpsProjectileComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "TimerManager.h"
 
 // Sets default values
 AShpsCharacter::AShpsCharacter()
 {
- 	// Set this character to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+ 	// Firing is driven by input and timers, projectiles tick in their own component
+	PrimaryActorTick.bCanEverTick = false;
 
+	HitscanTraceDelegate.BindUObject(this, &AShpsCharacter::OnHitscanTraceDone);
+
+	ProjectileComponent = CreateDefaultSubobject<UShpsProjectileComponent>(TEXT("ProjectileComponent"));
 }
 
 // Called when the game starts or when spawned
 void AShpsCharacter::BeginPlay()
 {
 	Super::BeginPlay();
-	
+
+	TObjectPtr<UShpsSelectionSubsystem> SelectionSubsystem = GetWorld()->GetSubsystem<UShpsSelectionSubsystem>();
+	if (bUseNativeSelection && SelectionSubsystem)
+	{
+		SelectionSubsystem->SetSelector(this);
+	}
+
+	//Every pawn registers on its own, so hits keep reaching the spawners after a respawn
+	TObjectPtr<UShpsSpawnerSubsystem> SpawnerSubsystem = GetWorld()->GetSubsystem<UShpsSpawnerSubsystem>();
+	if (SpawnerSubsystem)
+	{
+		SpawnerSubsystem->RegisterCharacter(this);
+	}
+
+	ProjectileComponent->OnProjectileHitDelegate.AddUObject(this, &AShpsCharacter::BroadcastShapeHit);
+}
+
+void AShpsCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	TObjectPtr<UShpsSelectionSubsystem> SelectionSubsystem = GetWorld()->GetSubsystem<UShpsSelectionSubsystem>();
+	if (SelectionSubsystem)
+	{
+		SelectionSubsystem->ClearSelector(this);
+	}
+
+	TObjectPtr<UShpsSpawnerSubsystem> SpawnerSubsystem = GetWorld()->GetSubsystem<UShpsSpawnerSubsystem>();
+	if (SpawnerSubsystem)
+	{
+		SpawnerSubsystem->UnregisterCharacter(this);
+	}
+
+	GetWorldTimerManager().ClearTimer(HitscanFireTimerHandle);
+	GetWorldTimerManager().ClearTimer(HitscanBroadcastTimerHandle);
+	PendingHitscanHits.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AShpsCharacter::BroadcastShapeHit(const FHitResult& HitResult)
+{
+	//Instanced spawners identify the shape by component and instance, actor shapes by themselves
+	UPrimitiveComponent* HitComponent = HitResult.GetComponent();
+	if (Cast<UInstancedStaticMeshComponent>(HitComponent) && HitResult.Item != INDEX_NONE)
+	{
+		OnShapeInstanceShootedDelegate.Broadcast(HitComponent, HitResult.Item);
+	}
+	else if (Cast<AShpsBaseShape>(HitResult.GetActor()))
+	{
+		OnShapeShootedDelegate.Broadcast(HitResult.GetActor());
+	}
+}
+
+void AShpsCharacter::FireHitscan()
+{
+	TObjectPtr<UWorld> World = GetWorld();
+	if (!World || !Controller)
+	{
+		return;
+	}
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	Controller->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ShpsHitscan), false, this);
+
+	//Runs on the async trace workers, the result comes back through the delegate at the start of the next frame
+	World->AsyncLineTraceByChannel(EAsyncTraceType::Single, ViewLocation, ViewLocation + ViewRotation.Vector() * HitscanRange, HitscanTraceChannel,
+		QueryParams, FCollisionResponseParams::DefaultResponseParam, &HitscanTraceDelegate);
+}
+
+void AShpsCharacter::StartHitscanFire()
+{
+	FireHitscan();
+	GetWorldTimerManager().SetTimer(HitscanFireTimerHandle, this, &AShpsCharacter::FireHitscan, 1.f / HitscanFireRate, true);
+}
+
+void AShpsCharacter::StopHitscanFire()
+{
+	GetWorldTimerManager().ClearTimer(HitscanFireTimerHandle);
+}
+
+void AShpsCharacter::FireProjectile()
+{
+	if (!Controller)
+	{
+		return;
+	}
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	Controller->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	const FVector Direction = ViewRotation.Vector();
+	ProjectileComponent->FireProjectile(ViewLocation + Direction * ProjectileSpawnOffset, Direction);
 }
 
-// Called every frame
-void AShpsCharacter::Tick(float DeltaTime)
+void AShpsCharacter::OnHitscanTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum)
 {
-	Super::Tick(DeltaTime);
+	if (TraceDatum.OutHits.Num() == 0)
+	{
+		return;
+	}
+
+	PendingHitscanHits.Append(TraceDatum.OutHits);
+
+	//Trace delegates run before the timers, so every shot finishing this frame goes out in the same broadcast
+	if (!HitscanBroadcastTimerHandle.IsValid())
+	{
+		HitscanBroadcastTimerHandle = GetWorldTimerManager().SetTimerForNextTick(this, &AShpsCharacter::BroadcastHitscanHits);
+	}
+}
+
+void AShpsCharacter::BroadcastHitscanHits()
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(AShpsCharacter::BroadcastHitscanHits);
+
+	HitscanBroadcastTimerHandle.Invalidate();
 
+	//Swapped out so a listener firing again doesn't touch the array being iterated
+	TArray<FHitResult> Hits = MoveTemp(PendingHitscanHits);
+	for (const FHitResult& Hit : Hits)
+	{
+		BroadcastShapeHit(Hit);
+	}
 }
 
 // Called to bind functionality to input
@@ -4,9 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "WorldCollision.h"
 #include "ShpsCharacter.generated.h"
 
 class AShpsBaseShpe;
+class UShpsProjectileComponent;
 
 UCLASS()
 class SHAPES_API AShpsCharacter : public ACharacter
@@ -15,6 +17,8 @@ class SHAPES_API AShpsCharacter : public ACharacter
 
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnShapeShootedSignaure, AActor*, BaseShapeActor);
 
+	DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnShapeInstanceShootedSignature, UPrimitiveComponent*, HitComponent, int32, InstanceIndex);
+
 public:
 	// Sets default values for this character's properties
 	AShpsCharacter();
@@ -22,14 +26,69 @@ public:
 	UPROPERTY(BlueprintCallable, BlueprintAssignable)
 	FOnShapeShootedSignaure OnShapeShootedDelegate;
 
+	//Hits on shapes rendered by an instanced spawner, InstanceIndex is the hit result's Item
+	UPROPERTY(BlueprintCallable, BlueprintAssignable)
+	FOnShapeInstanceShootedSignature OnShapeInstanceShootedDelegate;
+
+	//Broadcasts the matching shape-hit delegate, hits on anything but a shape are ignored by the spawners
+	void BroadcastShapeHit(const FHitResult& HitResult);
+
+	//One async trace along the view, its hit is broadcast on the next frame together with every other shot landing then
+	UFUNCTION(BlueprintCallable, Category = "Hitscan")
+	void FireHitscan();
+
+	//Fires at HitscanFireRate until stopped
+	UFUNCTION(BlueprintCallable, Category = "Hitscan")
+	void StartHitscanFire();
+
+	UFUNCTION(BlueprintCallable, Category = "Hitscan")
+	void StopHitscanFire();
+
+	//Native replacement for spawning a projectile actor per shot, fired along the view
+	UFUNCTION(BlueprintCallable, Category = "Projectiles")
+	void FireProjectile();
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
-public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	//Shapes under the crosshair are selected by UShpsSelectionSubsystem, Blueprint selection traces should be skipped while it is on
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Selection")
+	bool bUseNativeSelection = false;
+
+	void OnHitscanTraceDone(const FTraceHandle& TraceHandle, FTraceDatum& TraceDatum);
 
+	void BroadcastHitscanHits();
+
+	UPROPERTY(EditDefaultsOnly, Category = "Hitscan", meta = (ClampMin = "0", Units = "cm"))
+	float HitscanRange = 10000.f;
+
+	UPROPERTY(EditDefaultsOnly, Category = "Hitscan")
+	TEnumAsByte<ECollisionChannel> HitscanTraceChannel = ECC_Visibility;
+
+	//Shots per second while StartHitscanFire is held
+	UPROPERTY(EditDefaultsOnly, Category = "Hitscan", meta = (ClampMin = "0.1"))
+	float HitscanFireRate = 10.f;
+
+	FTraceDelegate HitscanTraceDelegate;
+
+	//Hits of the traces finished this frame, broadcast in one go
+	TArray<FHitResult> PendingHitscanHits;
+
+	FTimerHandle HitscanBroadcastTimerHandle;
+
+	FTimerHandle HitscanFireTimerHandle;
+
+	//Projectiles start this far in front of the view, clear of the capsule
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles", meta = (ClampMin = "0", Units = "cm"))
+	float ProjectileSpawnOffset = 100.f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	TObjectPtr<UShpsProjectileComponent> ProjectileComponent;
+
+public:	
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsBalanceBenchmarkCommandlet.h"
+#include "Shapes/Gameplay/ShapesSpawner/ShpsBalanceEngine.h"
+#include "Math/RandomStream.h"
+#include "HAL/PlatformTime.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShpsBalanceBenchmark, Log, All);
+
+UShpsBalanceBenchmarkCommandlet::UShpsBalanceBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+int32 UShpsBalanceBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 NumHits = 10000;
+	int32 NumPrimitiveTypes = 3;
+	int32 NumColors = 3;
+	int32 ToleranceNumber = 1;
+	FParse::Value(*Params, TEXT("Hits="), NumHits);
+	FParse::Value(*Params, TEXT("Types="), NumPrimitiveTypes);
+	FParse::Value(*Params, TEXT("Colors="), NumColors);
+	FParse::Value(*Params, TEXT("Tolerance="), ToleranceNumber);
+
+	if (NumHits <= 0 || NumPrimitiveTypes <= 0 || NumColors <= 0 || ToleranceNumber <= 0)
+	{
+		UE_LOG(LogShpsBalanceBenchmark, Error, TEXT("Hits, Types, Colors and Tolerance have to be positive"));
+		return 1;
+	}
+
+	const int32 FieldSizes[] = { 10, 1000, 100000 };
+	for (const int32 NumShapes : FieldSizes)
+	{
+		const double Seconds = RunHits(NumShapes, NumHits, NumPrimitiveTypes, NumColors, ToleranceNumber);
+		UE_LOG(LogShpsBalanceBenchmark, Display, TEXT("%d shapes, %d hits: %.1f ns per hit"), NumShapes, NumHits, Seconds * 1.0e9 / NumHits);
+	}
+
+	return 0;
+}
+
+double UShpsBalanceBenchmarkCommandlet::RunHits(int32 NumShapes, int32 NumHits, int32 NumPrimitiveTypes, int32 NumColors, int32 ToleranceNumber) const
+{
+	FShpsBalanceEngine BalanceEngine;
+	BalanceEngine.Init(NumPrimitiveTypes, NumColors, ToleranceNumber);
+
+	//Same layout as the spawner, every type in turn with colors assigned round robin
+	TArray<int32> LiveHandles;
+	LiveHandles.Reserve(NumShapes);
+	for (int32 Index = 0; Index < NumShapes; ++Index)
+	{
+		LiveHandles.Add(BalanceEngine.AddShape(Index % NumPrimitiveTypes, Index % NumColors));
+	}
+
+	FRandomStream RandomStream(NumShapes);
+	TArray<FShpsBalanceChange> BalanceChanges;
+
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32 Hit = 0; Hit < NumHits; ++Hit)
+	{
+		const int32 LiveIndex = RandomStream.RandHelper(LiveHandles.Num());
+		const int32 Handle = LiveHandles[LiveIndex];
+
+		LiveHandles.RemoveAtSwap(LiveIndex, 1, EAllowShrinking::No);
+		BalanceEngine.RemoveShape(Handle);
+
+		BalanceEngine.PlanRebalance(BalanceChanges);
+		for (const FShpsBalanceChange& Change : BalanceChanges)
+		{
+			BalanceEngine.MoveShape(Change.Handle, Change.PrimitiveTypeId, Change.ColorId);
+		}
+
+		//Refill so the field keeps its size for the whole run
+		LiveHandles.Add(BalanceEngine.AddShape(BalanceEngine.GetPrimitivesNum().GetLeast(), BalanceEngine.GetColorsNum().GetLeast()));
+	}
+
+	return FPlatformTime::Seconds() - StartTime;
+}
@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "ShpsBalanceBenchmarkCommandlet.generated.h"
+
+/**
+ * Replays random hits against FShpsBalanceEngine at several field sizes and logs the cost per hit.
+ * UnrealEditor-Cmd Shapes.uproject -run=ShpsBalanceBenchmark -nullrhi [-Hits=10000] [-Types=3] [-Colors=3] [-Tolerance=1]
+ */
+UCLASS()
+class SHAPES_API UShpsBalanceBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UShpsBalanceBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+	double RunHits(int32 NumShapes, int32 NumHits, int32 NumPrimitiveTypes, int32 NumColors, int32 ToleranceNumber) const;
+};
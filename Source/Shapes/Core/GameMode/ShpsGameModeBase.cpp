@@ -2,17 +2,37 @@
 
 
 #include "ShpsGameModeBase.h"
+#include "Misc/CommandLine.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShpsGameMode, Log, All);
 
 void AShpsGameModeBase::BeginPlay()
 {
 	Super::BeginPlay();
 
+	InitRandomStream();
 	GenerateRandomNumber(MinNumber, MaxNumber);
 }
 
+void AShpsGameModeBase::InitRandomStream()
+{
+	int32 Seed = RandomSeed;
+	FParse::Value(FCommandLine::Get(), TEXT("ShapesSeed="), Seed);
+	if (Seed == 0)
+	{
+		RandomStream.GenerateNewSeed();
+	}
+	else
+	{
+		RandomStream.Initialize(Seed);
+	}
+
+	UE_LOG(LogShpsGameMode, Log, TEXT("Random seed %d, pass -ShapesSeed=%d to replay this field"), RandomStream.GetInitialSeed(), RandomStream.GetInitialSeed());
+}
+
 void AShpsGameModeBase::GenerateRandomNumber(int Min, int Max)
 {
-	int RandomNumber = FMath::RandRange(Min, Max);
+	int RandomNumber = RandomStream.RandRange(Min, Max);
 	
-	OnRandomNumberGeneratedDelegate.Broadcast(RandomNumber);
+	OnRandomNumberGeneratedDelegate.Broadcast(RandomNumber, RandomStream);
 }
@@ -9,10 +9,11 @@
 /**
  * 
  */
-UCLASS()
+UCLASS(Config = Game)
 class SHAPES_API AShpsGameModeBase : public AGameModeBase
 {
-	DECLARE_MULTICAST_DELEGATE_OneParam(FOnRandomNumberGeneratedSignature, int);
+	//Listeners draw their own seed from the stream, in the order they bound
+	DECLARE_MULTICAST_DELEGATE_TwoParams(FOnRandomNumberGeneratedSignature, int, FRandomStream&);
 	
 	GENERATED_BODY()
 
@@ -22,8 +23,16 @@ public:
 protected:
 	virtual void BeginPlay() override;
 
+	void InitRandomStream();
+
 	void GenerateRandomNumber(int Min, int Max);
 
+	//Same seed gives the same field, 0 picks a new seed every run. -ShapesSeed=<seed> on the command line overrides it
+	UPROPERTY(EditDefaultsOnly, Config)
+	int32 RandomSeed = 0;
+
+	FRandomStream RandomStream;
+
 	UPROPERTY(EditDefaultsOnly)
 	int MinNumber = 4;
 	
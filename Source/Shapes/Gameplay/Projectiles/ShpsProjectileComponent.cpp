@@ -0,0 +1,175 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsProjectileComponent.h"
+#include "Shapes/Shapes.h"
+#include "Engine/World.h"
+#include "Engine/StaticMesh.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "CollisionQueryParams.h"
+
+DECLARE_CYCLE_STAT(TEXT("Step projectiles"), STAT_ShapesStepProjectiles, STATGROUP_Shapes);
+
+UShpsProjectileComponent::UShpsProjectileComponent()
+{
+	//Ticks only while projectiles are in flight
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+}
+
+void UShpsProjectileComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	Projectiles.SetNum(MaxProjectiles);
+	FirstProjectile = 0;
+	NumProjectiles = 0;
+	StepHits.Reserve(MaxProjectiles);
+
+	InitProjectileInstances();
+}
+
+void UShpsProjectileComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Projectiles.Empty();
+	FirstProjectile = 0;
+	NumProjectiles = 0;
+	StepHits.Empty();
+	InstanceTransforms.Empty();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UShpsProjectileComponent::FireProjectile(const FVector& Location, const FVector& Direction)
+{
+	if (Projectiles.Num() == 0)
+	{
+		return;
+	}
+
+	//When full the oldest slot is reused for the new projectile, which becomes the newest
+	FShpsProjectile* Projectile;
+	if (NumProjectiles == Projectiles.Num())
+	{
+		Projectile = &Projectiles[FirstProjectile];
+		FirstProjectile = (FirstProjectile + 1) % Projectiles.Num();
+	}
+	else
+	{
+		Projectile = &GetProjectile(NumProjectiles++);
+	}
+
+	Projectile->Location = Location;
+	Projectile->Velocity = Direction.GetSafeNormal() * Speed;
+	Projectile->Age = 0.f;
+
+	SetComponentTickEnabled(true);
+}
+
+void UShpsProjectileComponent::StepProjectiles(float DeltaTime)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesStepProjectiles);
+
+	TObjectPtr<UWorld> World = GetWorld();
+	const FVector Gravity(0.f, 0.f, World->GetGravityZ() * GravityScale);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(ShpsProjectile), false, GetOwner());
+	const FCollisionShape CollisionShape = Radius > 0.f ? FCollisionShape::MakeSphere(Radius) : FCollisionShape();
+
+	//Survivors are compacted in place from the front of the ring, keeping their firing order
+	int32 NumAlive = 0;
+	for (int32 Index = 0; Index < NumProjectiles; ++Index)
+	{
+		FShpsProjectile Projectile = GetProjectile(Index);
+
+		const FVector Start = Projectile.Location;
+		const FVector End = Start + Projectile.Velocity * DeltaTime + Gravity * (0.5f * DeltaTime * DeltaTime);
+
+		FHitResult HitResult;
+		if (World->SweepSingleByChannel(HitResult, Start, End, FQuat::Identity, TraceChannel, CollisionShape, QueryParams))
+		{
+			StepHits.Add(HitResult);
+			continue;
+		}
+
+		Projectile.Age += DeltaTime;
+		if (Projectile.Age >= LifeSpan)
+		{
+			continue;
+		}
+
+		Projectile.Location = End;
+		Projectile.Velocity += Gravity * DeltaTime;
+		GetProjectile(NumAlive++) = Projectile;
+	}
+	NumProjectiles = NumAlive;
+}
+
+void UShpsProjectileComponent::InitProjectileInstances()
+{
+	if (!ProjectileMesh)
+	{
+		return;
+	}
+
+	//Not attached to anything, the instances are placed in world space
+	ProjectileInstances = NewObject<UInstancedStaticMeshComponent>(GetOwner());
+	ProjectileInstances->SetStaticMesh(ProjectileMesh);
+	if (ProjectileMaterial)
+	{
+		ProjectileInstances->SetMaterial(0, ProjectileMaterial);
+	}
+	ProjectileInstances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	ProjectileInstances->SetCastShadow(false);
+	ProjectileInstances->RegisterComponent();
+
+	InstanceTransforms.Init(FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), Projectiles.Num());
+	ProjectileInstances->AddInstances(InstanceTransforms, false, true);
+	NumShownInstances = 0;
+}
+
+void UShpsProjectileComponent::UpdateProjectileInstances()
+{
+	if (!ProjectileInstances)
+	{
+		return;
+	}
+
+	const float MeshRadius = ProjectileMesh->GetBounds().SphereRadius;
+	const FVector Scale(Radius > 0.f && MeshRadius > 0.f ? Radius / MeshRadius : 1.f);
+
+	//Only the instances that were or are shown need an update, the ones past both stay at zero scale
+	const int32 NumToUpdate = FMath::Max(NumProjectiles, NumShownInstances);
+	InstanceTransforms.SetNum(NumToUpdate, EAllowShrinking::No);
+	for (int32 Index = 0; Index < NumToUpdate; ++Index)
+	{
+		const bool bShown = Index < NumProjectiles;
+		InstanceTransforms[Index] = FTransform(FQuat::Identity, bShown ? GetProjectile(Index).Location : FVector::ZeroVector, bShown ? Scale : FVector::ZeroVector);
+	}
+	NumShownInstances = NumProjectiles;
+
+	if (NumToUpdate > 0)
+	{
+		ProjectileInstances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true);
+	}
+}
+
+void UShpsProjectileComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	StepProjectiles(DeltaTime);
+	UpdateProjectileInstances();
+
+	//Broadcast once the step is done, so listeners firing again don't touch the array being stepped
+	for (const FHitResult& HitResult : StepHits)
+	{
+		OnProjectileHitDelegate.Broadcast(HitResult);
+	}
+	StepHits.Reset();
+
+	if (NumProjectiles == 0)
+	{
+		SetComponentTickEnabled(false);
+	}
+}
@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "ShpsProjectileComponent.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+class UMaterialInterface;
+
+struct FShpsProjectile
+{
+	FVector Location = FVector::ZeroVector;
+
+	FVector Velocity = FVector::ZeroVector;
+
+	float Age = 0.f;
+};
+
+/**
+ * Simulates every projectile its owner fires in one ring buffer, each step is a swept trace from the last position.
+ * Storage is allocated once up front, so firing and hitting don't create actors or allocate.
+ * Projectiles are drawn as instances of ProjectileMesh, without it they are only traces.
+ */
+UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
+class SHAPES_API UShpsProjectileComponent : public UActorComponent
+{
+	DECLARE_MULTICAST_DELEGATE_OneParam(FOnProjectileHitSignature, const FHitResult&);
+
+	GENERATED_BODY()
+
+public:
+	UShpsProjectileComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	//Broadcast after the step that hit, once per projectile
+	FOnProjectileHitSignature OnProjectileHitDelegate;
+
+	UFUNCTION(BlueprintCallable)
+	void FireProjectile(const FVector& Location, const FVector& Direction);
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	void StepProjectiles(float DeltaTime);
+
+	void InitProjectileInstances();
+
+	void UpdateProjectileInstances();
+
+	FShpsProjectile& GetProjectile(int32 Index) { return Projectiles[(FirstProjectile + Index) % Projectiles.Num()]; }
+
+	//Projectiles in flight at once, firing past it replaces the oldest one
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles", meta = (ClampMin = "1"))
+	int32 MaxProjectiles = 256;
+
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles", meta = (ClampMin = "0", Units = "cm/s"))
+	float Speed = 3000.f;
+
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles")
+	float GravityScale = 0.f;
+
+	//0 traces a line, anything above sweeps a sphere
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles", meta = (ClampMin = "0", Units = "cm"))
+	float Radius = 5.f;
+
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles", meta = (ClampMin = "0.1", Units = "s"))
+	float LifeSpan = 3.f;
+
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles")
+	TEnumAsByte<ECollisionChannel> TraceChannel = ECC_Visibility;
+
+	//Scaled so its bounding sphere matches Radius
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles|Rendering")
+	TObjectPtr<UStaticMesh> ProjectileMesh;
+
+	UPROPERTY(EditDefaultsOnly, Category = "Projectiles|Rendering")
+	TObjectPtr<UMaterialInterface> ProjectileMaterial;
+
+	//MaxProjectiles slots, the NumProjectiles in flight start at FirstProjectile oldest first
+	TArray<FShpsProjectile> Projectiles;
+
+	int32 FirstProjectile = 0;
+
+	int32 NumProjectiles = 0;
+
+	//One instance per slot of the ring, in the same order as the projectiles in flight
+	UPROPERTY(Transient)
+	TObjectPtr<UInstancedStaticMeshComponent> ProjectileInstances;
+
+	//Instances shown after the last update, the rest are scaled to zero
+	int32 NumShownInstances = 0;
+
+	TArray<FTransform> InstanceTransforms;
+
+	//Reused every step
+	TArray<FHitResult> StepHits;
+};
@@ -0,0 +1,223 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsSelectionSubsystem.h"
+#include "Shapes/Shapes.h"
+#include "Shapes/Gameplay/ShapesSpawner/ShpsShapesSpawner.h"
+#include "Shapes/Core/Character/ShpsCharacter.h"
+#include "GameFramework/Controller.h"
+
+DECLARE_CYCLE_STAT(TEXT("Selection query"), STAT_ShapesSelectionQuery, STATGROUP_Shapes);
+
+UShpsSelectionSubsystem::UShpsSelectionSubsystem()
+	: Octree(FVector::ZeroVector, HALF_WORLD_MAX)
+{
+}
+
+bool UShpsSelectionSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UShpsSelectionSubsystem::Deinitialize()
+{
+	Selector.Reset();
+	TargetSpawner = nullptr;
+	TargetHandle = INDEX_NONE;
+	OctreeIds.Empty();
+	Octree.Destroy();
+
+	Super::Deinitialize();
+}
+
+void UShpsSelectionSubsystem::AddShape(AShpsShapesSpawner* Spawner, int32 Handle, const FBoxSphereBounds& Bounds)
+{
+	FShpsSelectableShape Shape;
+	Shape.Spawner = Spawner;
+	Shape.Handle = Handle;
+	Shape.Bounds = Bounds;
+	Shape.OctreeId = MakeShared<FOctreeElementId2>();
+
+	OctreeIds.Add(TPair<AShpsShapesSpawner*, int32>(Spawner, Handle), Shape.OctreeId);
+	Octree.AddElement(Shape);
+}
+
+void UShpsSelectionSubsystem::RemoveShape(AShpsShapesSpawner* Spawner, int32 Handle)
+{
+	TSharedPtr<FOctreeElementId2> OctreeId;
+	if (!OctreeIds.RemoveAndCopyValue(TPair<AShpsShapesSpawner*, int32>(Spawner, Handle), OctreeId))
+	{
+		return;
+	}
+
+	Octree.RemoveElement(*OctreeId);
+
+	//The owner already hid whatever it showed for the shape, the handle may be reused by another shape
+	if (TargetSpawner == Spawner && TargetHandle == Handle)
+	{
+		TargetSpawner = nullptr;
+		TargetHandle = INDEX_NONE;
+	}
+}
+
+void UShpsSelectionSubsystem::UpdateShape(AShpsShapesSpawner* Spawner, int32 Handle, const FBoxSphereBounds& Bounds)
+{
+	const TSharedPtr<FOctreeElementId2>* OctreeId = OctreeIds.Find(TPair<AShpsShapesSpawner*, int32>(Spawner, Handle));
+	if (!OctreeId)
+	{
+		return;
+	}
+
+	FShpsSelectableShape Shape = Octree.GetElementById(**OctreeId);
+	Octree.RemoveElement(**OctreeId);
+	Shape.Bounds = Bounds;
+	Octree.AddElement(Shape);
+}
+
+void UShpsSelectionSubsystem::RemoveSpawnerShapes(AShpsShapesSpawner* Spawner)
+{
+	for (auto It = OctreeIds.CreateIterator(); It; ++It)
+	{
+		if (It.Key().Key == Spawner)
+		{
+			Octree.RemoveElement(*It.Value());
+			It.RemoveCurrent();
+		}
+	}
+
+	if (TargetSpawner == Spawner)
+	{
+		TargetSpawner = nullptr;
+		TargetHandle = INDEX_NONE;
+	}
+}
+
+bool UShpsSelectionSubsystem::FindShapeAlongRay(const FVector& Start, const FVector& End, FShpsSelectableShape& OutShape) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesSelectionQuery);
+
+	const FVector StartToEnd = End - Start;
+	const double RayLength = StartToEnd.Size();
+	if (RayLength <= UE_KINDA_SMALL_NUMBER)
+	{
+		return false;
+	}
+	const FVector Direction = StartToEnd / RayLength;
+
+	const FShpsSelectableShape* HitShape = nullptr;
+	double HitDistance = TNumericLimits<double>::Max();
+
+	const FShpsSelectableShape* NearShape = nullptr;
+	double NearMiss = TNumericLimits<double>::Max();
+
+	//Nodes are only entered when the ray passes through their loose bounds widened by the selection slack
+	Octree.FindElementsWithPredicate(
+		[this, &Start, &End, &StartToEnd](FOctreeNodeIndex ParentNodeIndex, FOctreeNodeIndex NodeIndex, const FBoxCenterAndExtent& NodeBounds)
+		{
+			return FMath::LineBoxIntersection(NodeBounds.GetBox().ExpandBy(SelectionRadius), Start, End, StartToEnd);
+		},
+		[this, &Start, &End, &StartToEnd, &Direction, RayLength, &HitShape, &HitDistance, &NearShape, &NearMiss](FOctreeNodeIndex ParentNodeIndex, const FShpsSelectableShape& Shape)
+		{
+			const FVector ToCenter = Shape.Bounds.Origin - Start;
+			const double AlongRay = FMath::Clamp(FVector::DotProduct(ToCenter, Direction), 0.0, RayLength);
+
+			if (FMath::LineBoxIntersection(Shape.Bounds.GetBox(), Start, End, StartToEnd))
+			{
+				if (AlongRay < HitDistance)
+				{
+					HitShape = &Shape;
+					HitDistance = AlongRay;
+				}
+				return;
+			}
+
+			const double Miss = FVector::Dist(Start + Direction * AlongRay, Shape.Bounds.Origin) - Shape.Bounds.SphereRadius;
+			if (Miss <= SelectionRadius && Miss < NearMiss)
+			{
+				NearShape = &Shape;
+				NearMiss = Miss;
+			}
+		});
+
+	const FShpsSelectableShape* FoundShape = HitShape ? HitShape : NearShape;
+	if (!FoundShape)
+	{
+		return false;
+	}
+
+	OutShape = *FoundShape;
+	return true;
+}
+
+void UShpsSelectionSubsystem::SetSelector(AShpsCharacter* Character)
+{
+	Selector = Character;
+}
+
+void UShpsSelectionSubsystem::ClearSelector(AShpsCharacter* Character)
+{
+	if (Selector.Get() != Character)
+	{
+		return;
+	}
+
+	Selector.Reset();
+	SetTarget(nullptr, INDEX_NONE);
+}
+
+void UShpsSelectionSubsystem::SetTarget(AShpsShapesSpawner* Spawner, int32 Handle)
+{
+	//Select and Unselect only go out when the target actually changes
+	if (Spawner == TargetSpawner && Handle == TargetHandle)
+	{
+		return;
+	}
+
+	if (TargetSpawner)
+	{
+		TargetSpawner->UnselectShape(TargetHandle);
+	}
+
+	TargetSpawner = Spawner;
+	TargetHandle = Handle;
+
+	if (TargetSpawner)
+	{
+		TargetSpawner->SelectShape(TargetHandle);
+	}
+}
+
+bool UShpsSelectionSubsystem::IsTickable() const
+{
+	return Selector.IsValid();
+}
+
+TStatId UShpsSelectionSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UShpsSelectionSubsystem, STATGROUP_Tickables);
+}
+
+void UShpsSelectionSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	const TObjectPtr<AController> Controller = Selector.IsValid() ? Selector->GetController() : nullptr;
+	if (!Controller)
+	{
+		return;
+	}
+
+	FVector ViewLocation;
+	FRotator ViewRotation;
+	Controller->GetPlayerViewPoint(ViewLocation, ViewRotation);
+
+	FShpsSelectableShape Shape;
+	if (FindShapeAlongRay(ViewLocation, ViewLocation + ViewRotation.Vector() * SelectionDistance, Shape))
+	{
+		SetTarget(Shape.Spawner, Shape.Handle);
+	}
+	else
+	{
+		SetTarget(nullptr, INDEX_NONE);
+	}
+}
@@ -0,0 +1,109 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Math/GenericOctree.h"
+#include "ShpsSelectionSubsystem.generated.h"
+
+class AShpsShapesSpawner;
+class AShpsCharacter;
+
+struct FShpsSelectableShape
+{
+	AShpsShapesSpawner* Spawner = nullptr;
+
+	int32 Handle = INDEX_NONE;
+
+	FBoxSphereBounds Bounds = FBoxSphereBounds(ForceInit);
+
+	//Shared with the subsystem, the octree writes the element's current id here whenever it moves the element
+	TSharedPtr<FOctreeElementId2> OctreeId;
+};
+
+struct FShpsSelectionOctreeSemantics
+{
+	enum { MaxElementsPerLeaf = 16 };
+	enum { MinInclusiveElementsPerNode = 7 };
+	enum { MaxNodeDepth = 12 };
+
+	typedef TInlineAllocator<MaxElementsPerLeaf> ElementAllocator;
+
+	FORCEINLINE static FBoxCenterAndExtent GetBoundingBox(const FShpsSelectableShape& Element)
+	{
+		return FBoxCenterAndExtent(Element.Bounds);
+	}
+
+	FORCEINLINE static bool AreElementsEqual(const FShpsSelectableShape& A, const FShpsSelectableShape& B)
+	{
+		return A.Spawner == B.Spawner && A.Handle == B.Handle;
+	}
+
+	FORCEINLINE static void SetElementId(const FShpsSelectableShape& Element, FOctreeElementId2 Id)
+	{
+		*Element.OctreeId = Id;
+	}
+};
+
+typedef TOctree2<FShpsSelectableShape, FShpsSelectionOctreeSemantics> FShpsSelectionOctree;
+
+/**
+ * Live shapes of every spawner in an octree, so finding the shape under the crosshair only visits the nodes the view ray passes through.
+ * Spawners keep their shapes up to date, a character with bUseNativeSelection becomes the selector and gets its target selected every frame.
+ */
+UCLASS(Config = Game)
+class SHAPES_API UShpsSelectionSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	UShpsSelectionSubsystem();
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual bool IsTickable() const override;
+
+	virtual TStatId GetStatId() const override;
+
+	void AddShape(AShpsShapesSpawner* Spawner, int32 Handle, const FBoxSphereBounds& Bounds);
+
+	void RemoveShape(AShpsShapesSpawner* Spawner, int32 Handle);
+
+	//For retypes, the shape stays selected
+	void UpdateShape(AShpsShapesSpawner* Spawner, int32 Handle, const FBoxSphereBounds& Bounds);
+
+	void RemoveSpawnerShapes(AShpsShapesSpawner* Spawner);
+
+	//Closest shape the segment passes through, or the one passing nearest within SelectionRadius when it hits none
+	bool FindShapeAlongRay(const FVector& Start, const FVector& End, FShpsSelectableShape& OutShape) const;
+
+	void SetSelector(AShpsCharacter* Character);
+
+	void ClearSelector(AShpsCharacter* Character);
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	virtual void Deinitialize() override;
+
+	void SetTarget(AShpsShapesSpawner* Spawner, int32 Handle);
+
+	//How far from the camera shapes can be selected, in cm
+	UPROPERTY(Config)
+	float SelectionDistance = 10000.f;
+
+	//Slack around the view ray, so small or distant shapes don't need a pixel perfect aim
+	UPROPERTY(Config)
+	float SelectionRadius = 10.f;
+
+	FShpsSelectionOctree Octree;
+
+	TMap<TPair<AShpsShapesSpawner*, int32>, TSharedPtr<FOctreeElementId2>> OctreeIds;
+
+	TWeakObjectPtr<AShpsCharacter> Selector;
+
+	AShpsShapesSpawner* TargetSpawner = nullptr;
+
+	int32 TargetHandle = INDEX_NONE;
+};
@@ -5,12 +5,13 @@
 #include "Components/StaticMeshComponent.h"
 #include "Components/WidgetComponent.h"
 #include "Shapes/UI/Widgets/ShpsTooltipWidget.h"
+#include "Shapes/Gameplay/ShapesSpawner/ShpsShapesSpawner.h"
 
 // Sets default values
 AShpsBaseShape::AShpsBaseShape()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+ 	// Shapes only change when hit, retyped or selected
+	PrimaryActorTick.bCanEverTick = false;
 
 	StaticMeshComponent = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("StaticMeshComponent"));
 	RootComponent = StaticMeshComponent;
@@ -23,47 +24,84 @@ AShpsBaseShape::AShpsBaseShape()
 
 FText AShpsBaseShape::GetPrimitiveType()
 {
-	return PrimitiveType;
+	const AShpsShapesSpawner* Spawner = Cast<AShpsShapesSpawner>(GetOwner());
+	return Spawner ? Spawner->GetPrimitiveTypeName(PrimitiveTypeId) : FText::GetEmpty();
 }
 
 FText AShpsBaseShape::GetPrimitiveColor()
 {
-	return PrimitiveColor;
+	const AShpsShapesSpawner* Spawner = Cast<AShpsShapesSpawner>(GetOwner());
+	return Spawner ? Spawner->GetColorName(PrimitiveColorId) : FText::GetEmpty();
 }
 
 FText AShpsBaseShape::GetPrimitiveSize()
 {
-	return PrimitiveSize;
+	const AShpsShapesSpawner* Spawner = Cast<AShpsShapesSpawner>(GetOwner());
+	return Spawner ? Spawner->GetPrimitiveSizeText(PrimitiveTypeId, StaticMeshComponent->GetComponentScale()) : FText::GetEmpty();
 }
 
-void AShpsBaseShape::SetPrimitiveTypeInfo(const TSubclassOf<AShpsBaseShape>& Primitive, TMap<TSubclassOf<AShpsBaseShape>, FText>& Primitives)
+void AShpsBaseShape::SetPrimitiveTypeInfo(int32 TypeId)
 {
-	PrimitiveType = *(Primitives.Find(Primitive));
+	PrimitiveTypeId = TypeId;
 }
 
-void AShpsBaseShape::SetPrimitiveColorInfo(const FLinearColor& Color, TMap<FLinearColor, FText> Colors)
+void AShpsBaseShape::SetPrimitiveType(int32 TypeId, const FShpsPrimitiveEntry& PrimitiveEntry)
 {
-	PrimitiveColor = *(Colors.Find(Color));
+	PrimitiveTypeId = TypeId;
+
+	StaticMeshComponent->SetStaticMesh(PrimitiveEntry.Mesh);
+
+	//The body is live here, so the collision setup goes through the setters instead of copying the body instance
+	StaticMeshComponent->SetCollisionProfileName(PrimitiveEntry.CollisionProfileName, false);
+	StaticMeshComponent->SetCollisionObjectType(PrimitiveEntry.CollisionObjectType);
+	StaticMeshComponent->SetCollisionResponseToChannels(PrimitiveEntry.CollisionResponses);
+	StaticMeshComponent->SetCollisionEnabled(PrimitiveEntry.CollisionEnabled);
+
+	//The owner applies its color instance of the new base material right after
+	BaseMaterial = PrimitiveEntry.BaseMaterial;
 }
 
-void AShpsBaseShape::SetPrimitiveSizeInfo()
+void AShpsBaseShape::SetPrimitiveColorInfo(int32 ColorId)
 {
-	FVector MinVec, MaxVec;
-	this->StaticMeshComponent->GetLocalBounds(MinVec, MaxVec);
-	FVector Size = MinVec.GetAbs() + MaxVec;
-	Size = Size * StaticMeshComponent->GetComponentScale();
+	PrimitiveColorId = ColorId;
+}
+
+void AShpsBaseShape::SetShapeActive(bool bActive)
+{
+	bShapeActive = bActive;
+
+	SetActorHiddenInGame(!bActive);
+	SetActorEnableCollision(bActive);
+	SetActorTickEnabled(bActive);
 
-	PrimitiveSize = Size.ToText();
+	if (!bActive)
+	{
+		WidgetComponent->SetVisibility(false);
+		WidgetComponent->SetComponentTickEnabled(false);
+	}
 }
 
 void AShpsBaseShape::SelectPrimitive_Implementation()
 {
+	if (!WidgetComponent->GetUserWidgetObject() && TooltipWidgetClass)
+	{
+		WidgetComponent->SetWidgetClass(TooltipWidgetClass);
+
+		TObjectPtr<UShpsTooltipWidget> TooltipWidget = Cast<UShpsTooltipWidget>(WidgetComponent->GetUserWidgetObject());
+		if (TooltipWidget)
+		{
+			TooltipWidget->SetSelectableInterfaceActor(this);
+		}
+	}
+
+	WidgetComponent->SetComponentTickEnabled(true);
 	WidgetComponent->SetVisibility(true);
 }
 
 void AShpsBaseShape::UnselectPrimitive_Implementation()
 {
 	WidgetComponent->SetVisibility(false);
+	WidgetComponent->SetComponentTickEnabled(false);
 }
 
 FText AShpsBaseShape::GetType_Implementation()
@@ -81,24 +119,22 @@ FText AShpsBaseShape::GetSize_Implementation()
 	return GetPrimitiveSize();
 }
 
-// Called when the game starts or when spawned
-void AShpsBaseShape::BeginPlay()
+void AShpsBaseShape::PostInitializeComponents()
 {
-	Super::BeginPlay();
+	Super::PostInitializeComponents();
 
-	WidgetComponent->SetVisibility(false);
-	
-	TObjectPtr<UShpsTooltipWidget> TooltipWidget =  Cast<UShpsTooltipWidget>(WidgetComponent->GetUserWidgetObject());
-	if (TooltipWidget)
-	{
-		TooltipWidget->SetSelectableInterfaceActor(this);
-	}
+	BaseMaterial = StaticMeshComponent->GetMaterial(0);
+
+	//Clearing the class before BeginPlay keeps the widget component from creating the tooltip up front
+	TooltipWidgetClass = WidgetComponent->GetWidgetClass();
+	WidgetComponent->SetWidgetClass(nullptr);
 }
 
-// Called every frame
-void AShpsBaseShape::Tick(float DeltaTime)
+// Called when the game starts or when spawned
+void AShpsBaseShape::BeginPlay()
 {
-	Super::Tick(DeltaTime);
+	Super::BeginPlay();
 
+	WidgetComponent->SetVisibility(false);
+	WidgetComponent->SetComponentTickEnabled(false);
 }
-
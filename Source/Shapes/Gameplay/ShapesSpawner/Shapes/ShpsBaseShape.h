@@ -9,7 +9,10 @@
 
 class UWidgetComponent;
 class UStaticMeshComponent;
+class UMaterialInterface;
+class UUserWidget;
 class FText;
+struct FShpsPrimitiveEntry;
 
 UCLASS()
 class SHAPES_API AShpsBaseShape : public AActor, public IShpsSelectableInterface
@@ -27,12 +30,26 @@ public:
 	FText GetPrimitiveColor();
 
 	FText GetPrimitiveSize();
-	
-	void SetPrimitiveTypeInfo(const TSubclassOf<AShpsBaseShape>& Primitive, TMap<TSubclassOf<AShpsBaseShape>, FText>& Primitives);
 
-	void SetPrimitiveColorInfo(const FLinearColor& Color, TMap<FLinearColor, FText> Colors);
+	int32 GetPrimitiveTypeId() const { return PrimitiveTypeId; }
+
+	int32 GetPrimitiveColorId() const { return PrimitiveColorId; }
+
+	int32 GetShapeHandle() const { return ShapeHandle; }
+
+	void SetShapeHandle(int32 Handle) { ShapeHandle = Handle; }
+
+	//Pooled shapes are hidden and stop colliding instead of being destroyed
+	void SetShapeActive(bool bActive);
+
+	bool IsShapeActive() const { return bShapeActive; }
 	
-	void SetPrimitiveSizeInfo();
+	void SetPrimitiveTypeInfo(int32 TypeId);
+
+	//Takes over mesh, base material and collision of another primitive type, so a retype keeps the same actor
+	void SetPrimitiveType(int32 TypeId, const FShpsPrimitiveEntry& PrimitiveEntry);
+
+	void SetPrimitiveColorInfo(int32 ColorId);
 
 	void SelectPrimitive_Implementation() override;
 
@@ -44,10 +61,14 @@ public:
 
 	FText GetSize_Implementation() override;
 
-	UPROPERTY()
-	TObjectPtr<UMaterialInstanceDynamic> ShapeMaterialInstanceDynamic;
+	UStaticMeshComponent* GetStaticMeshComponent() const { return StaticMeshComponent; }
+
+	//Material the mesh was authored with, before any color instance was applied
+	UMaterialInterface* GetBaseMaterial() const { return BaseMaterial; }
 
 protected:
+	virtual void PostInitializeComponents() override;
+
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
@@ -57,17 +78,23 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	TObjectPtr<UWidgetComponent> WidgetComponent;
 
-	UPROPERTY(EditAnywhere, BlueprintReadOnly)
-	FText PrimitiveType;
+	//Category ids resolved by the owning spawner, display names are looked up only when asked for
+	UPROPERTY(VisibleInstanceOnly, BlueprintReadOnly)
+	int32 PrimitiveTypeId = INDEX_NONE;
 	
-	UPROPERTY(EditAnywhere, BlueprintReadOnly)
-	FText PrimitiveColor;
-	
-	UPROPERTY(EditAnywhere, BlueprintReadOnly)
-	FText PrimitiveSize;
+	UPROPERTY(VisibleInstanceOnly, BlueprintReadOnly)
+	int32 PrimitiveColorId = INDEX_NONE;
 
-public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	//Handle of this shape in the owning spawner's shape index
+	UPROPERTY(VisibleInstanceOnly)
+	int32 ShapeHandle = INDEX_NONE;
+
+	bool bShapeActive = true;
 
+	UPROPERTY()
+	TObjectPtr<UMaterialInterface> BaseMaterial;
+
+	//Widget class authored on WidgetComponent, the widget itself is only created the first time the shape is selected
+	UPROPERTY()
+	TSubclassOf<UUserWidget> TooltipWidgetClass;
 };
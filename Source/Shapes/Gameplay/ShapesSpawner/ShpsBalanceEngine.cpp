@@ -0,0 +1,194 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsBalanceEngine.h"
+#include "Shapes/Shapes.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+DECLARE_CYCLE_STAT(TEXT("Plan rebalance"), STAT_ShapesPlanRebalance, STATGROUP_Shapes);
+
+void FShpsBalanceEngine::Init(int32 NumPrimitiveTypes, int32 NumColors, int32 InToleranceNumber)
+{
+	//A tolerance of 0 can't be met when the shapes don't split evenly
+	ensureMsgf(InToleranceNumber >= 1, TEXT("ToleranceNumber %d must be at least 1"), InToleranceNumber);
+	ToleranceNumber = InToleranceNumber;
+
+	PrimitivesNum.Init(NumPrimitiveTypes);
+	ColorsNum.Init(NumColors);
+	ShapeIndex.Init(NumPrimitiveTypes, NumColors);
+}
+
+int32 FShpsBalanceEngine::AddShape(int32 PrimitiveTypeId, int32 ColorId)
+{
+	PrimitivesNum.Increment(PrimitiveTypeId);
+	ColorsNum.Increment(ColorId);
+
+	return ShapeIndex.Add(PrimitiveTypeId, ColorId);
+}
+
+void FShpsBalanceEngine::RemoveShape(int32 Handle)
+{
+	PrimitivesNum.Decrement(ShapeIndex.GetPrimitiveTypeId(Handle));
+	ColorsNum.Decrement(ShapeIndex.GetColorId(Handle));
+
+	ShapeIndex.Remove(Handle);
+}
+
+void FShpsBalanceEngine::MoveShape(int32 Handle, int32 PrimitiveTypeId, int32 ColorId)
+{
+	PrimitivesNum.Decrement(ShapeIndex.GetPrimitiveTypeId(Handle));
+	ColorsNum.Decrement(ShapeIndex.GetColorId(Handle));
+
+	ShapeIndex.Move(Handle, PrimitiveTypeId, ColorId);
+
+	PrimitivesNum.Increment(PrimitiveTypeId);
+	ColorsNum.Increment(ColorId);
+}
+
+void FShpsBalanceEngine::PlanRebalance(TArray<FShpsBalanceChange>& OutChanges) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesPlanRebalance);
+
+	OutChanges.Reset();
+	if (!PrimitivesTypeAboveToleranceNumber() && !ColorsAboveToleranceNumber())
+	{
+		return;
+	}
+
+	FPlan Plan;
+	Plan.Changes = &OutChanges;
+	Plan.PrimitivesNum = PrimitivesNum;
+	Plan.ColorsNum = ColorsNum;
+	Plan.CellsTaken.SetNumZeroed(PrimitivesNum.Num() * ColorsNum.Num());
+
+	//Each step moves one shape from the largest to the least category, fixing a type and a color at once when both are out
+	for (int32 Step = 0; Step < ShapeIndex.Num(); ++Step)
+	{
+		const bool PrimitiveTypeOverrepresented = Plan.PrimitivesNum.GetLargestCount() - Plan.PrimitivesNum.GetLeastCount() > ToleranceNumber;
+		const bool PrimitiveColorOverrepresented = Plan.ColorsNum.GetLargestCount() - Plan.ColorsNum.GetLeastCount() > ToleranceNumber;
+
+		bool bPlanned = false;
+
+		//Need PrimitiveType and Color adjustments
+		if (PrimitiveColorOverrepresented && PrimitiveTypeOverrepresented)
+		{
+			bPlanned = PlanAdjustColorsAndPrimitiveType(Plan) || PlanAdjustPrimitiveType(Plan) || PlanAdjustColors(Plan);
+		}
+		//Need just primitiveType adjumstment, colors are good
+		else if (PrimitiveTypeOverrepresented)
+		{
+			bPlanned = PlanAdjustPrimitiveType(Plan);
+		}
+		//Need just color adjustment, primitives are good
+		else if (PrimitiveColorOverrepresented)
+		{
+			bPlanned = PlanAdjustColors(Plan);
+		}
+
+		if (!bPlanned)
+		{
+			break;
+		}
+	}
+}
+
+bool FShpsBalanceEngine::SameNumberOfEachPrimitive() const
+{
+	return PrimitivesNum.GetLargestCount() == PrimitivesNum.GetLeastCount();
+}
+
+bool FShpsBalanceEngine::SameNumberOfEachColor() const
+{
+	return ColorsNum.GetLargestCount() == ColorsNum.GetLeastCount();
+}
+
+bool FShpsBalanceEngine::PrimitivesTypeAboveToleranceNumber() const
+{
+	return PrimitivesNum.GetLargestCount() - PrimitivesNum.GetLeastCount() > ToleranceNumber;
+}
+
+bool FShpsBalanceEngine::ColorsAboveToleranceNumber() const
+{
+	return ColorsNum.GetLargestCount() - ColorsNum.GetLeastCount() > ToleranceNumber;
+}
+
+int32 FShpsBalanceEngine::TakeFromCell(FPlan& Plan, int32 PrimitiveTypeId, int32 ColorId) const
+{
+	const int32 Cell = PrimitiveTypeId * ColorsNum.Num() + ColorId;
+	const int32 CellNum = ShapeIndex.GetCellNum(PrimitiveTypeId, ColorId);
+	if (Plan.CellsTaken[Cell] >= CellNum)
+	{
+		return INDEX_NONE;
+	}
+
+	++Plan.CellsTaken[Cell];
+	return ShapeIndex.GetCellHandle(PrimitiveTypeId, ColorId, CellNum - Plan.CellsTaken[Cell]);
+}
+
+void FShpsBalanceEngine::AddPlannedChange(FPlan& Plan, int32 Handle, int32 FromPrimitiveTypeId, int32 FromColorId, int32 PrimitiveTypeId, int32 ColorId) const
+{
+	Plan.PrimitivesNum.Decrement(FromPrimitiveTypeId);
+	Plan.ColorsNum.Decrement(FromColorId);
+	Plan.PrimitivesNum.Increment(PrimitiveTypeId);
+	Plan.ColorsNum.Increment(ColorId);
+
+	FShpsBalanceChange& Change = Plan.Changes->AddDefaulted_GetRef();
+	Change.Handle = Handle;
+	Change.PrimitiveTypeId = PrimitiveTypeId;
+	Change.ColorId = ColorId;
+}
+
+bool FShpsBalanceEngine::PlanAdjustColors(FPlan& Plan) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FShpsBalanceEngine::PlanAdjustColors);
+
+	const int32 LargestColorId = Plan.ColorsNum.GetLargest();
+	const int32 LeastColorId = Plan.ColorsNum.GetLeast();
+
+	for (const int32 PrimitiveTypeId : ShapeIndex.GetNonEmptyPrimitiveTypes(LargestColorId))
+	{
+		const int32 Handle = TakeFromCell(Plan, PrimitiveTypeId, LargestColorId);
+		if (Handle != INDEX_NONE)
+		{
+			AddPlannedChange(Plan, Handle, PrimitiveTypeId, LargestColorId, PrimitiveTypeId, LeastColorId);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FShpsBalanceEngine::PlanAdjustPrimitiveType(FPlan& Plan) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FShpsBalanceEngine::PlanAdjustPrimitiveType);
+
+	const int32 LargestPrimitiveTypeId = Plan.PrimitivesNum.GetLargest();
+	const int32 LeastPrimitiveTypeId = Plan.PrimitivesNum.GetLeast();
+
+	for (const int32 ColorId : ShapeIndex.GetNonEmptyColors(LargestPrimitiveTypeId))
+	{
+		const int32 Handle = TakeFromCell(Plan, LargestPrimitiveTypeId, ColorId);
+		if (Handle != INDEX_NONE)
+		{
+			AddPlannedChange(Plan, Handle, LargestPrimitiveTypeId, ColorId, LeastPrimitiveTypeId, ColorId);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FShpsBalanceEngine::PlanAdjustColorsAndPrimitiveType(FPlan& Plan) const
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FShpsBalanceEngine::PlanAdjustColorsAndPrimitiveType);
+
+	const int32 LargestPrimitiveTypeId = Plan.PrimitivesNum.GetLargest();
+	const int32 LargestColorId = Plan.ColorsNum.GetLargest();
+
+	const int32 Handle = TakeFromCell(Plan, LargestPrimitiveTypeId, LargestColorId);
+	if (Handle == INDEX_NONE)
+	{
+		return false;
+	}
+
+	AddPlannedChange(Plan, Handle, LargestPrimitiveTypeId, LargestColorId, Plan.PrimitivesNum.GetLeast(), Plan.ColorsNum.GetLeast());
+	return true;
+}
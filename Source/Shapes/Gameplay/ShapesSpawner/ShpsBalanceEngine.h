@@ -0,0 +1,89 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ShpsCategoryCounter.h"
+#include "ShpsShapeIndex.h"
+
+//Category a planned shape has to be moved to
+struct FShpsBalanceChange
+{
+	int32 Handle = INDEX_NONE;
+	int32 PrimitiveTypeId = INDEX_NONE;
+	int32 ColorId = INDEX_NONE;
+};
+
+/**
+ * Balance rules of the shapes field, independent of actors and the world. It keeps the live shapes per category
+ * and plans which shapes have to change category to bring the field back within tolerance, the caller applies the
+ * changes to whatever represents the shapes and confirms each with MoveShape.
+ */
+class SHAPES_API FShpsBalanceEngine
+{
+public:
+	void Init(int32 NumPrimitiveTypes, int32 NumColors, int32 InToleranceNumber);
+
+	int32 AddShape(int32 PrimitiveTypeId, int32 ColorId);
+
+	void RemoveShape(int32 Handle);
+
+	void MoveShape(int32 Handle, int32 PrimitiveTypeId, int32 ColorId);
+
+	//Every change needed to bring the largest and least type and color within ToleranceNumber of each other, each shape changes at most once.
+	//OutChanges is left empty when the field is already balanced
+	void PlanRebalance(TArray<FShpsBalanceChange>& OutChanges) const;
+
+	bool SameNumberOfEachPrimitive() const;
+
+	bool SameNumberOfEachColor() const;
+
+	bool PrimitivesTypeAboveToleranceNumber() const;
+
+	bool ColorsAboveToleranceNumber() const;
+
+	bool IsValidHandle(int32 Handle) const { return ShapeIndex.IsValidHandle(Handle); }
+
+	int32 GetPrimitiveTypeId(int32 Handle) const { return ShapeIndex.GetPrimitiveTypeId(Handle); }
+
+	int32 GetColorId(int32 Handle) const { return ShapeIndex.GetColorId(Handle); }
+
+	int32 Num() const { return ShapeIndex.Num(); }
+
+	const FShpsCategoryCounter& GetPrimitivesNum() const { return PrimitivesNum; }
+
+	const FShpsCategoryCounter& GetColorsNum() const { return ColorsNum; }
+
+	const FShpsShapeIndex& GetShapeIndex() const { return ShapeIndex; }
+
+private:
+	//Counts as they will be once the changes planned so far are applied
+	struct FPlan
+	{
+		FShpsCategoryCounter PrimitivesNum;
+		FShpsCategoryCounter ColorsNum;
+
+		//Shapes taken out of each cell so far, always the last ones of the cell so none is taken twice
+		TArray<int32> CellsTaken;
+
+		TArray<FShpsBalanceChange>* Changes = nullptr;
+	};
+
+	int32 TakeFromCell(FPlan& Plan, int32 PrimitiveTypeId, int32 ColorId) const;
+
+	void AddPlannedChange(FPlan& Plan, int32 Handle, int32 FromPrimitiveTypeId, int32 FromColorId, int32 PrimitiveTypeId, int32 ColorId) const;
+
+	bool PlanAdjustColors(FPlan& Plan) const;
+
+	bool PlanAdjustPrimitiveType(FPlan& Plan) const;
+
+	bool PlanAdjustColorsAndPrimitiveType(FPlan& Plan) const;
+
+	int32 ToleranceNumber = 1;
+
+	//Number of live shapes per category id
+	FShpsCategoryCounter PrimitivesNum;
+	FShpsCategoryCounter ColorsNum;
+
+	FShpsShapeIndex ShapeIndex;
+};
@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsCategoryCounter.h"
+
+void FShpsCategoryCounter::Init(int32 NumCategories)
+{
+	Counts.Init(0, NumCategories);
+	Order.SetNumUninitialized(NumCategories);
+	Positions.SetNumUninitialized(NumCategories);
+	for (int32 Category = 0; Category < NumCategories; ++Category)
+	{
+		Order[Category] = Category;
+		Positions[Category] = Category;
+	}
+
+	BucketFirst.Init(INDEX_NONE, 1);
+	BucketLast.Init(INDEX_NONE, 1);
+	if (NumCategories > 0)
+	{
+		BucketFirst[0] = 0;
+		BucketLast[0] = NumCategories - 1;
+	}
+}
+
+void FShpsCategoryCounter::Increment(int32 Category)
+{
+	const int32 Count = Counts[Category];
+	const int32 NewCount = Count + 1;
+
+	//Move the category to the end of its bucket, that slot becomes the start of the next bucket
+	const int32 Index = BucketLast[Count];
+	SwapOrder(Positions[Category], Index);
+
+	if (BucketFirst[Count] == Index)
+	{
+		BucketFirst[Count] = INDEX_NONE;
+		BucketLast[Count] = INDEX_NONE;
+	}
+	else
+	{
+		BucketLast[Count] = Index - 1;
+	}
+
+	if (!BucketFirst.IsValidIndex(NewCount))
+	{
+		BucketFirst.Add(INDEX_NONE);
+		BucketLast.Add(INDEX_NONE);
+	}
+
+	if (BucketFirst[NewCount] == INDEX_NONE)
+	{
+		BucketLast[NewCount] = Index;
+	}
+	BucketFirst[NewCount] = Index;
+
+	Counts[Category] = NewCount;
+}
+
+void FShpsCategoryCounter::Decrement(int32 Category)
+{
+	const int32 Count = Counts[Category];
+	if (!ensure(Count > 0))
+	{
+		return;
+	}
+	const int32 NewCount = Count - 1;
+
+	//Move the category to the start of its bucket, that slot becomes the end of the previous bucket
+	const int32 Index = BucketFirst[Count];
+	SwapOrder(Positions[Category], Index);
+
+	if (BucketLast[Count] == Index)
+	{
+		BucketFirst[Count] = INDEX_NONE;
+		BucketLast[Count] = INDEX_NONE;
+	}
+	else
+	{
+		BucketFirst[Count] = Index + 1;
+	}
+
+	if (BucketLast[NewCount] == INDEX_NONE)
+	{
+		BucketFirst[NewCount] = Index;
+	}
+	BucketLast[NewCount] = Index;
+
+	Counts[Category] = NewCount;
+}
+
+void FShpsCategoryCounter::SwapOrder(int32 IndexA, int32 IndexB)
+{
+	if (IndexA != IndexB)
+	{
+		Order.Swap(IndexA, IndexB);
+		Positions[Order[IndexA]] = IndexA;
+		Positions[Order[IndexB]] = IndexB;
+	}
+}
@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Live shape count per category id. Categories are kept sorted by count in buckets of equal count,
+ * so the most and least populated category are known in O(1) and a count changes by one in O(1).
+ */
+class SHAPES_API FShpsCategoryCounter
+{
+public:
+	void Init(int32 NumCategories);
+
+	void Increment(int32 Category);
+
+	void Decrement(int32 Category);
+
+	int32 Num() const { return Counts.Num(); }
+
+	int32 GetCount(int32 Category) const { return Counts[Category]; }
+
+	int32 GetLargest() const { return Order.Num() > 0 ? Order.Last() : INDEX_NONE; }
+
+	int32 GetLeast() const { return Order.Num() > 0 ? Order[0] : INDEX_NONE; }
+
+	int32 GetLargestCount() const { return Order.Num() > 0 ? Counts[Order.Last()] : 0; }
+
+	int32 GetLeastCount() const { return Order.Num() > 0 ? Counts[Order[0]] : 0; }
+
+private:
+	void SwapOrder(int32 IndexA, int32 IndexB);
+
+	TArray<int32> Counts;
+
+	//Categories sorted by ascending count and the position of each category in it
+	TArray<int32> Order;
+	TArray<int32> Positions;
+
+	//First and last position in Order of the categories with a given count, INDEX_NONE if there are none
+	TArray<int32> BucketFirst;
+	TArray<int32> BucketLast;
+};
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsHitRecording.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+static const uint32 HitRecordingMagic = 0x53485048; //SHPH
+static const int32 HitRecordingVersion = 2;
+
+void FShpsHitRecording::Reset(int32 InNumShapes, int32 InSeed)
+{
+	NumShapes = InNumShapes;
+	Seed = InSeed;
+	Hits.Reset();
+}
+
+void FShpsHitRecording::Add(int32 Handle, float Time)
+{
+	FShpsHitRecord& Hit = Hits.AddDefaulted_GetRef();
+	Hit.Handle = Handle;
+	Hit.Time = Time;
+}
+
+bool FShpsHitRecording::SaveToFile(const FString& FilePath) const
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	Writer << const_cast<FShpsHitRecording&>(*this);
+
+	return FFileHelper::SaveArrayToFile(Bytes, *FilePath);
+}
+
+bool FShpsHitRecording::LoadFromFile(const FString& FilePath)
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *FilePath))
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(Bytes);
+	Reader << *this;
+
+	return !Reader.IsError();
+}
+
+FArchive& operator<<(FArchive& Ar, FShpsHitRecording& Recording)
+{
+	uint32 Magic = HitRecordingMagic;
+	int32 Version = HitRecordingVersion;
+	Ar << Magic << Version;
+	if (Magic != HitRecordingMagic || Version != HitRecordingVersion)
+	{
+		Ar.SetError();
+		return Ar;
+	}
+
+	Ar << Recording.NumShapes << Recording.Seed;
+
+	int32 NumHits = Recording.Hits.Num();
+	Ar << NumHits;
+	if (Ar.IsLoading())
+	{
+		//Each hit is a handle and a time
+		if (NumHits < 0 || NumHits > (Ar.TotalSize() - Ar.Tell()) / 8)
+		{
+			Ar.SetError();
+			return Ar;
+		}
+		Recording.Hits.SetNum(NumHits);
+	}
+
+	for (FShpsHitRecord& Hit : Recording.Hits)
+	{
+		Ar << Hit.Handle << Hit.Time;
+	}
+	return Ar;
+}
@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FShpsHitRecord
+{
+	int32 Handle = INDEX_NONE;
+
+	//Seconds since the field was ready
+	float Time = 0.f;
+};
+
+/**
+ * Hits taken by one spawner's field, saved as a small binary file so the same sequence can be replayed headless.
+ * Handles only mean the same shapes when the field is spawned again with the same seed, so the header carries it.
+ */
+class SHAPES_API FShpsHitRecording
+{
+public:
+	void Reset(int32 InNumShapes, int32 InSeed);
+
+	void Add(int32 Handle, float Time);
+
+	bool SaveToFile(const FString& FilePath) const;
+
+	bool LoadFromFile(const FString& FilePath);
+
+	int32 GetNumShapes() const { return NumShapes; }
+
+	int32 GetSeed() const { return Seed; }
+
+	const TArray<FShpsHitRecord>& GetHits() const { return Hits; }
+
+	friend FArchive& operator<<(FArchive& Ar, FShpsHitRecording& Recording);
+
+private:
+	//Size and seed of the field the hits were recorded on
+	int32 NumShapes = 0;
+
+	int32 Seed = 0;
+
+	TArray<FShpsHitRecord> Hits;
+};
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsPlacementGrid.h"
+
+void FShpsPlacementGrid::Init(float MaxRadius)
+{
+	CellSize = FMath::Max(MaxRadius * 2.f, 1.f);
+	LargestRadius = 0.f;
+	Spheres.Reset();
+	Cells.Reset();
+}
+
+bool FShpsPlacementGrid::IsFree(const FVector& Center, float Radius) const
+{
+	const FVector Reach(Radius + LargestRadius);
+	const FIntVector MinCell = GetCell(Center - Reach);
+	const FIntVector MaxCell = GetCell(Center + Reach);
+
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				const TArray<int32>* Cell = Cells.Find(FIntVector(X, Y, Z));
+				if (!Cell)
+				{
+					continue;
+				}
+
+				for (const int32 SphereIndex : *Cell)
+				{
+					const FSphere& Sphere = Spheres[SphereIndex];
+					if (FVector::DistSquared(Sphere.Center, Center) < FMath::Square(Sphere.W + Radius))
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+void FShpsPlacementGrid::Add(const FVector& Center, float Radius)
+{
+	const int32 SphereIndex = Spheres.Emplace(Center, Radius);
+	Cells.FindOrAdd(GetCell(Center)).Add(SphereIndex);
+	LargestRadius = FMath::Max(LargestRadius, Radius);
+}
+
+FIntVector FShpsPlacementGrid::GetCell(const FVector& Location) const
+{
+	return FIntVector(
+		FMath::FloorToInt32(Location.X / CellSize),
+		FMath::FloorToInt32(Location.Y / CellSize),
+		FMath::FloorToInt32(Location.Z / CellSize));
+}
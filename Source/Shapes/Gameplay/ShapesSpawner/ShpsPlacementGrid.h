@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Spatial hash of the bounding spheres placed so far. Cells are at least as large as the biggest sphere,
+ * so an overlap test only looks at the few cells around the candidate position.
+ */
+class SHAPES_API FShpsPlacementGrid
+{
+public:
+	void Init(float MaxRadius);
+
+	bool IsFree(const FVector& Center, float Radius) const;
+
+	void Add(const FVector& Center, float Radius);
+
+private:
+	FIntVector GetCell(const FVector& Location) const;
+
+	float CellSize = 1.f;
+
+	//Largest radius added so far, bounds the neighbourhood an overlap test has to look at
+	float LargestRadius = 0.f;
+
+	TArray<FSphere> Spheres;
+
+	//Indices into Spheres per cell containing the sphere center
+	TMap<FIntVector, TArray<int32>> Cells;
+};
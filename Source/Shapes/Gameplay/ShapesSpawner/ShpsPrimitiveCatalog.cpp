@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsPrimitiveCatalog.h"
+#include "Shapes/ShpsBaseShape.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+
+void FShpsPrimitiveCatalog::Add(TSubclassOf<AShpsBaseShape> ShapeClass, const FText& DisplayName)
+{
+	FShpsPrimitiveEntry& Entry = Entries.AddDefaulted_GetRef();
+	Entry.ShapeClass = ShapeClass;
+	Entry.DisplayName = DisplayName;
+
+	const UStaticMeshComponent* MeshTemplate = GetDefault<AShpsBaseShape>(ShapeClass)->GetStaticMeshComponent();
+	if (!MeshTemplate)
+	{
+		return;
+	}
+
+	Entry.Mesh = MeshTemplate->GetStaticMesh();
+	Entry.BaseMaterial = MeshTemplate->GetMaterial(0);
+	Entry.BodyInstance.CopyBodyInstancePropertiesFrom(&MeshTemplate->BodyInstance);
+	Entry.CollisionProfileName = MeshTemplate->GetCollisionProfileName();
+	Entry.CollisionObjectType = MeshTemplate->GetCollisionObjectType();
+	Entry.CollisionResponses = MeshTemplate->GetCollisionResponseToChannels();
+	Entry.CollisionEnabled = MeshTemplate->GetCollisionEnabled();
+
+	if (Entry.Mesh)
+	{
+		Entry.MeshBounds = Entry.Mesh->GetBounds();
+		MaxRadius = FMath::Max(MaxRadius, static_cast<float>(Entry.MeshBounds.SphereRadius));
+	}
+}
+
+FText FShpsPrimitiveCatalog::GetSizeText(int32 PrimitiveTypeId, const FVector& WorldScale) const
+{
+	if (!Entries.IsValidIndex(PrimitiveTypeId))
+	{
+		return FText::GetEmpty();
+	}
+
+	const FVector Size = Entries[PrimitiveTypeId].MeshBounds.BoxExtent * 2.0 * WorldScale;
+	return Size.ToText();
+}
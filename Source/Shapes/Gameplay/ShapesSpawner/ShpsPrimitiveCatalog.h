@@ -0,0 +1,81 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PhysicsEngine/BodyInstance.h"
+#include "ShpsPrimitiveCatalog.generated.h"
+
+class AShpsBaseShape;
+class UStaticMesh;
+class UMaterialInterface;
+
+//Everything a shape needs to become a given primitive type, taken once from the class defaults
+USTRUCT()
+struct FShpsPrimitiveEntry
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TSubclassOf<AShpsBaseShape> ShapeClass;
+
+	UPROPERTY()
+	FText DisplayName;
+
+	UPROPERTY()
+	TObjectPtr<UStaticMesh> Mesh;
+
+	UPROPERTY()
+	TObjectPtr<UMaterialInterface> BaseMaterial;
+
+	//Collision setup of the class's mesh component, copied whole onto components that have no physics state yet
+	UPROPERTY()
+	FBodyInstance BodyInstance;
+
+	//The same collision setup for live components, which can only take it through the collision setters
+	UPROPERTY()
+	FName CollisionProfileName;
+
+	UPROPERTY()
+	TEnumAsByte<ECollisionChannel> CollisionObjectType = ECC_WorldDynamic;
+
+	UPROPERTY()
+	FCollisionResponseContainer CollisionResponses;
+
+	UPROPERTY()
+	TEnumAsByte<ECollisionEnabled::Type> CollisionEnabled = ECollisionEnabled::QueryAndPhysics;
+
+	//Bounds of the mesh itself, scaled by the shape's world scale wherever they are used
+	UPROPERTY()
+	FBoxSphereBounds MeshBounds = FBoxSphereBounds(ForceInit);
+};
+
+/**
+ * Primitive types of a spawner, the index is the primitive type id carried by shapes.
+ * Built once when the primitive classes are loaded and only read afterwards.
+ */
+USTRUCT()
+struct FShpsPrimitiveCatalog
+{
+	GENERATED_BODY()
+
+public:
+	void Add(TSubclassOf<AShpsBaseShape> ShapeClass, const FText& DisplayName);
+
+	int32 Num() const { return Entries.Num(); }
+
+	bool IsValidIndex(int32 PrimitiveTypeId) const { return Entries.IsValidIndex(PrimitiveTypeId); }
+
+	const FShpsPrimitiveEntry& Get(int32 PrimitiveTypeId) const { return Entries[PrimitiveTypeId]; }
+
+	//Largest mesh bounding sphere radius at world scale 1
+	float GetMaxRadius() const { return MaxRadius; }
+
+	FText GetSizeText(int32 PrimitiveTypeId, const FVector& WorldScale) const;
+
+private:
+	UPROPERTY()
+	TArray<FShpsPrimitiveEntry> Entries;
+
+	float MaxRadius = 0.f;
+};
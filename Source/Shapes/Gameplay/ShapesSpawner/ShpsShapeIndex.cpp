@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsShapeIndex.h"
+
+void FShpsShapeIndex::Init(int32 InNumPrimitiveTypes, int32 InNumColors)
+{
+	NumPrimitiveTypes = InNumPrimitiveTypes;
+	NumColors = InNumColors;
+
+	Entries.Reset();
+	FreeHandles.Reset();
+	Cells.Reset();
+	Cells.SetNum(NumPrimitiveTypes * NumColors);
+
+	NonEmptyColors.Reset();
+	NonEmptyColors.SetNum(NumPrimitiveTypes);
+	NonEmptyPrimitiveTypes.Reset();
+	NonEmptyPrimitiveTypes.SetNum(NumColors);
+	ColorSlots.Init(INDEX_NONE, NumPrimitiveTypes * NumColors);
+	PrimitiveTypeSlots.Init(INDEX_NONE, NumPrimitiveTypes * NumColors);
+}
+
+int32 FShpsShapeIndex::Add(int32 PrimitiveTypeId, int32 ColorId)
+{
+	const int32 Handle = FreeHandles.Num() > 0 ? FreeHandles.Pop(EAllowShrinking::No) : Entries.AddDefaulted();
+
+	FEntry& Entry = Entries[Handle];
+	Entry.PrimitiveTypeId = PrimitiveTypeId;
+	Entry.ColorId = ColorId;
+	AddToCell(Handle);
+
+	return Handle;
+}
+
+void FShpsShapeIndex::Remove(int32 Handle)
+{
+	if (IsValidHandle(Handle))
+	{
+		RemoveFromCell(Handle);
+		Entries[Handle] = FEntry();
+		FreeHandles.Add(Handle);
+	}
+}
+
+void FShpsShapeIndex::Move(int32 Handle, int32 PrimitiveTypeId, int32 ColorId)
+{
+	if (IsValidHandle(Handle))
+	{
+		RemoveFromCell(Handle);
+		Entries[Handle].PrimitiveTypeId = PrimitiveTypeId;
+		Entries[Handle].ColorId = ColorId;
+		AddToCell(Handle);
+	}
+}
+
+void FShpsShapeIndex::AddToCell(int32 Handle)
+{
+	FEntry& Entry = Entries[Handle];
+	TArray<int32>& Cell = Cells[GetCell(Entry.PrimitiveTypeId, Entry.ColorId)];
+	Entry.Slot = Cell.Add(Handle);
+
+	if (Cell.Num() == 1)
+	{
+		LinkCell(Entry.PrimitiveTypeId, Entry.ColorId);
+	}
+}
+
+void FShpsShapeIndex::RemoveFromCell(int32 Handle)
+{
+	FEntry& Entry = Entries[Handle];
+	TArray<int32>& Cell = Cells[GetCell(Entry.PrimitiveTypeId, Entry.ColorId)];
+
+	//Swap the last shape of the cell into the freed slot
+	const int32 LastHandle = Cell.Last();
+	Cell[Entry.Slot] = LastHandle;
+	Entries[LastHandle].Slot = Entry.Slot;
+	Cell.Pop(EAllowShrinking::No);
+	Entry.Slot = INDEX_NONE;
+
+	if (Cell.Num() == 0)
+	{
+		UnlinkCell(Entry.PrimitiveTypeId, Entry.ColorId);
+	}
+}
+
+void FShpsShapeIndex::LinkCell(int32 PrimitiveTypeId, int32 ColorId)
+{
+	const int32 Cell = GetCell(PrimitiveTypeId, ColorId);
+	ColorSlots[Cell] = NonEmptyColors[PrimitiveTypeId].Add(ColorId);
+	PrimitiveTypeSlots[Cell] = NonEmptyPrimitiveTypes[ColorId].Add(PrimitiveTypeId);
+}
+
+void FShpsShapeIndex::UnlinkCell(int32 PrimitiveTypeId, int32 ColorId)
+{
+	const int32 Cell = GetCell(PrimitiveTypeId, ColorId);
+
+	//Same swap with the last entry as for the cells themselves
+	TArray<int32>& Colors = NonEmptyColors[PrimitiveTypeId];
+	const int32 LastColorId = Colors.Last();
+	Colors[ColorSlots[Cell]] = LastColorId;
+	ColorSlots[GetCell(PrimitiveTypeId, LastColorId)] = ColorSlots[Cell];
+	Colors.Pop(EAllowShrinking::No);
+	ColorSlots[Cell] = INDEX_NONE;
+
+	TArray<int32>& PrimitiveTypes = NonEmptyPrimitiveTypes[ColorId];
+	const int32 LastPrimitiveTypeId = PrimitiveTypes.Last();
+	PrimitiveTypes[PrimitiveTypeSlots[Cell]] = LastPrimitiveTypeId;
+	PrimitiveTypeSlots[GetCell(LastPrimitiveTypeId, ColorId)] = PrimitiveTypeSlots[Cell];
+	PrimitiveTypes.Pop(EAllowShrinking::No);
+	PrimitiveTypeSlots[Cell] = INDEX_NONE;
+}
@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Live shapes grouped by (primitive type, color) cell. Each shape is identified by a stable handle,
+ * so a shape of a given category can be found, moved or removed without scanning the whole field.
+ */
+class SHAPES_API FShpsShapeIndex
+{
+public:
+	void Init(int32 InNumPrimitiveTypes, int32 InNumColors);
+
+	int32 Add(int32 PrimitiveTypeId, int32 ColorId);
+
+	void Remove(int32 Handle);
+
+	void Move(int32 Handle, int32 PrimitiveTypeId, int32 ColorId);
+
+	bool IsValidHandle(int32 Handle) const { return Entries.IsValidIndex(Handle) && Entries[Handle].Slot != INDEX_NONE; }
+
+	int32 GetPrimitiveTypeId(int32 Handle) const { return Entries[Handle].PrimitiveTypeId; }
+
+	int32 GetColorId(int32 Handle) const { return Entries[Handle].ColorId; }
+
+	int32 GetNumHandles() const { return Entries.Num(); }
+
+	int32 Num() const { return Entries.Num() - FreeHandles.Num(); }
+
+	int32 GetCellNum(int32 PrimitiveTypeId, int32 ColorId) const { return Cells[GetCell(PrimitiveTypeId, ColorId)].Num(); }
+
+	int32 GetCellHandle(int32 PrimitiveTypeId, int32 ColorId, int32 Index) const { return Cells[GetCell(PrimitiveTypeId, ColorId)][Index]; }
+
+	//Colors whose cell with the given primitive type holds at least one shape, in no particular order
+	const TArray<int32>& GetNonEmptyColors(int32 PrimitiveTypeId) const { return NonEmptyColors[PrimitiveTypeId]; }
+
+	const TArray<int32>& GetNonEmptyPrimitiveTypes(int32 ColorId) const { return NonEmptyPrimitiveTypes[ColorId]; }
+
+private:
+	struct FEntry
+	{
+		int32 PrimitiveTypeId = INDEX_NONE;
+		int32 ColorId = INDEX_NONE;
+		int32 Slot = INDEX_NONE;
+	};
+
+	int32 GetCell(int32 PrimitiveTypeId, int32 ColorId) const { return PrimitiveTypeId * NumColors + ColorId; }
+
+	void AddToCell(int32 Handle);
+
+	void RemoveFromCell(int32 Handle);
+
+	void LinkCell(int32 PrimitiveTypeId, int32 ColorId);
+
+	void UnlinkCell(int32 PrimitiveTypeId, int32 ColorId);
+
+	int32 NumPrimitiveTypes = 0;
+	int32 NumColors = 0;
+
+	TArray<FEntry> Entries;
+	TArray<int32> FreeHandles;
+	TArray<TArray<int32>> Cells;
+
+	//Non-empty cells per row and column, so a shape of a type or a color is found without scanning the row
+	TArray<TArray<int32>> NonEmptyColors;
+	TArray<TArray<int32>> NonEmptyPrimitiveTypes;
+
+	//Position of each cell in the two lists above, INDEX_NONE while the cell is empty
+	TArray<int32> ColorSlots;
+	TArray<int32> PrimitiveTypeSlots;
+};
@@ -2,26 +2,58 @@
 
 
 #include "ShpsShapesSpawner.h"
+#include "Shapes/Shapes.h"
 #include "Shapes/ShpsBaseShape.h"
 #include "Components/BoxComponent.h"
 #include "Engine/World.h"
-#include "Kismet/KismetMathLibrary.h"
 #include "Kismet/GameplayStatics.h"
 #include "Shapes/Core/GameMode/ShpsGameModeBase.h"
 #include "Containers/Map.h"
-#include "Shapes/Core/Character/ShpsCharacter.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/WidgetComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Shapes/UI/Widgets/ShpsTooltipWidget.h"
+#include "Async/ParallelFor.h"
+#include "Math/RandomStream.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Paths.h"
+#include "TimerManager.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
+#include "Shapes/Gameplay/Selection/ShpsSelectionSubsystem.h"
+#include "ShpsSpawnerSubsystem.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShpsSpawner, Log, All);
+
+DECLARE_CYCLE_STAT(TEXT("InitSpawner"), STAT_ShapesInitSpawner, STATGROUP_Shapes);
+DECLARE_CYCLE_STAT(TEXT("Precompute spawns"), STAT_ShapesPrecomputeSpawns, STATGROUP_Shapes);
+DECLARE_CYCLE_STAT(TEXT("Spawn pending shapes"), STAT_ShapesSpawnPendingShapes, STATGROUP_Shapes);
+DECLARE_CYCLE_STAT(TEXT("Shape shooted"), STAT_ShapesShapeShooted, STATGROUP_Shapes);
+DECLARE_CYCLE_STAT(TEXT("Rebalance"), STAT_ShapesRebalance, STATGROUP_Shapes);
+DECLARE_CYCLE_STAT(TEXT("Change shape category"), STAT_ShapesChangeShapeCategory, STATGROUP_Shapes);
+DECLARE_CYCLE_STAT(TEXT("Update counts"), STAT_ShapesUpdateCounts, STATGROUP_Shapes);
+DECLARE_CYCLE_STAT(TEXT("Assign material"), STAT_ShapesAssignMaterial, STATGROUP_Shapes);
+
+static const FName ColorParameterName(TEXT("Color"));
 
 // Sets default values
 AShpsShapesSpawner::AShpsShapesSpawner()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+ 	// Ticks only while the initial spawn queue is being drained or hits are replayed
 	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
 	
 	StaticMeshComponent = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("StaticMeshComponent"));
 	RootComponent = StaticMeshComponent;
 
 	BoxComponent = CreateDefaultSubobject<UBoxComponent>(TEXT("BoxComponent"));
 	BoxComponent->SetupAttachment(StaticMeshComponent);
+
+	TooltipWidgetComponent = CreateDefaultSubobject<UWidgetComponent>(TEXT("TooltipWidgetComponent"));
+	TooltipWidgetComponent->SetupAttachment(StaticMeshComponent);
+	TooltipWidgetComponent->SetWidgetSpace(EWidgetSpace::Screen);
+	TooltipWidgetComponent->SetDrawAtDesiredSize(true);
 }
 
 // Called when the game starts or when spawned
@@ -35,460 +67,1094 @@ void AShpsShapesSpawner::BeginPlay()
 		GameModeBase->OnRandomNumberGeneratedDelegate.AddUObject(this, &AShpsShapesSpawner::OnRandomNumberGenerated);
 	}
 
-	TObjectPtr<AShpsCharacter> PlayerCharacter = Cast<AShpsCharacter>(UGameplayStatics::GetPlayerCharacter(this, 0));
-	if (PlayerCharacter)
+	SpawnerSubsystem = GetWorld()->GetSubsystem<UShpsSpawnerSubsystem>();
+	if (SpawnerSubsystem)
+	{
+		SpawnerSubsystem->RegisterSpawner(this);
+	}
+
+	SelectionSubsystem = GetWorld()->GetSubsystem<UShpsSelectionSubsystem>();
+
+	TooltipWidgetComponent->SetVisibility(false);
+
+	TObjectPtr<UShpsTooltipWidget> TooltipWidget = Cast<UShpsTooltipWidget>(TooltipWidgetComponent->GetUserWidgetObject());
+	if (TooltipWidget)
 	{
-		PlayerCharacter->OnShapeShootedDelegate.AddDynamic(this, &AShpsShapesSpawner::OnShapeShooted);
+		TooltipWidget->SetSelectableInterfaceActor(this);
 	}
 
 	//Init helpers
 	for (const auto& Color : ColorsMap)
 	{
-		ColorsMapString.Add(Color.Key, Color.Value.ToString());
+		Colors.Add(Color.Key);
+		ColorNames.Add(Color.Value);
 	}
 
-	for (const auto& Primitive : PrimitivesMap)
+	if (MinSpawnScale > MaxSpawnScale)
 	{
-		PrimitivesMapString.Add(Primitive.Key, Primitive.Value.ToString());
+		UE_LOG(LogShpsSpawner, Warning, TEXT("%s has MinSpawnScale %f above MaxSpawnScale %f, swapping them"), *GetName(), MinSpawnScale, MaxSpawnScale);
+		Swap(MinSpawnScale, MaxSpawnScale);
 	}
+
+	//Base materials don't read the per-instance color, every instance would come out the same
+	if (bUseInstancedRendering && !InstancedMaterial)
+	{
+		UE_LOG(LogShpsSpawner, Warning, TEXT("%s has no InstancedMaterial, spawning shape actors instead of instances"), *GetName());
+		bUseInstancedRendering = false;
+	}
+
+	LoadPrimitiveTypes();
+
+	InitHitRecording();
+
+#if STATS
+	GetWorldTimerManager().SetTimer(RebalanceRateTimerHandle, this, &AShpsShapesSpawner::UpdateRebalanceRateStat, RebalanceRateSampleInterval, true);
+#endif
 }
 
-AShpsBaseShape* AShpsShapesSpawner::SpawnShapeInRandomLocAndSize(const TSubclassOf<AShpsBaseShape>& Primitive)
+void AShpsShapesSpawner::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	TObjectPtr<UWorld> World = GetWorld();
-	if (World)
+	if (bRecordingHits)
 	{
-		FActorSpawnParameters SpawnParams;
-		SpawnParams.Owner = this;
-				
-		FVector BoxLocation = BoxComponent->GetComponentLocation();
-		FVector BoxExtent = BoxComponent->GetUnscaledBoxExtent();
-		FVector RandomLocationInBox = UKismetMathLibrary::RandomPointInBoundingBox(BoxLocation, BoxExtent);
-				
-		float RandomSizeFloat = UKismetMathLibrary::RandomFloatInRange(0.5, 2.5);
-		FVector RandomSize = FVector(RandomSizeFloat);
-
-		FTransform SpawnTransform;
-		SpawnTransform.SetLocation(RandomLocationInBox);
-		SpawnTransform.SetScale3D(RandomSize);
-
-		AShpsBaseShape* SpawnedShape = World->SpawnActor<AShpsBaseShape>(Primitive, SpawnTransform, SpawnParams);
-		if (SpawnedShape)
+		const FString FilePath = GetHitRecordingPath(HitRecordingName);
+		if (!HitRecording.SaveToFile(FilePath))
 		{
-			return SpawnedShape;
+			UE_LOG(LogShpsSpawner, Warning, TEXT("Couldn't save hit recording to %s"), *FilePath);
 		}
+		bRecordingHits = false;
 	}
-	return nullptr;
+
+	if (SelectionSubsystem)
+	{
+		SelectionSubsystem->RemoveSpawnerShapes(this);
+	}
+
+	if (SpawnerSubsystem)
+	{
+		SpawnerSubsystem->UnregisterSpawner(this);
+	}
+	bInGlobalBalance = false;
+
+#if STATS
+	//Take this spawner's share out of the accumulated stats
+	int32 PooledShapesNum = 0;
+	for (const FShpsShapePool& ShapePool : ShapePools)
+	{
+		PooledShapesNum += ShapePool.Shapes.Num();
+	}
+
+	int32 ColorMaterialsNum = 0;
+	for (const auto& ColorMaterials : ColorMaterialsCache)
+	{
+		ColorMaterialsNum += ColorMaterials.Value.Instances.FilterByPredicate([](const TObjectPtr<UMaterialInstanceDynamic>& Instance) { return Instance != nullptr; }).Num();
+	}
+
+	DEC_DWORD_STAT_BY(STAT_ShapesLive, BalanceEngine.Num());
+	DEC_DWORD_STAT_BY(STAT_ShapesPooled, PooledShapesNum);
+	DEC_DWORD_STAT_BY(STAT_ShapesColorMIDs, ColorMaterialsNum);
+	DEC_FLOAT_STAT_BY(STAT_ShapesRebalancesPerSecond, ReportedRebalanceRate);
+	GetWorldTimerManager().ClearTimer(RebalanceRateTimerHandle);
+#endif
+
+	Super::EndPlay(EndPlayReason);
+}
+
+FText AShpsShapesSpawner::GetPrimitiveTypeName(int32 PrimitiveTypeId) const
+{
+	return PrimitiveCatalog.IsValidIndex(PrimitiveTypeId) ? PrimitiveCatalog.Get(PrimitiveTypeId).DisplayName : FText::GetEmpty();
+}
+
+FText AShpsShapesSpawner::GetColorName(int32 ColorId) const
+{
+	return ColorNames.IsValidIndex(ColorId) ? ColorNames[ColorId] : FText::GetEmpty();
+}
+
+void AShpsShapesSpawner::SelectShapeInstance(UPrimitiveComponent* Component, int32 InstanceIndex)
+{
+	const int32 Handle = FindInstanceHandle(Component, InstanceIndex);
+	if (Handle == INDEX_NONE)
+	{
+		UnselectShapeInstance();
+		return;
+	}
+
+	SelectShape(Handle);
+}
+
+void AShpsShapesSpawner::UnselectShapeInstance()
+{
+	SelectedHandle = INDEX_NONE;
+
+	Execute_UnselectPrimitive(this);
+}
+
+void AShpsShapesSpawner::SelectShape(int32 Handle)
+{
+	if (!BalanceEngine.IsValidHandle(Handle))
+	{
+		return;
+	}
+
+	if (!bUseInstancedRendering)
+	{
+		Execute_SelectPrimitive(ShapesArray[Handle]);
+		return;
+	}
+
+	SelectedHandle = Handle;
+
+	FTransform InstanceTransform;
+	InstancedPrimitives[BalanceEngine.GetPrimitiveTypeId(Handle)].Component->GetInstanceTransform(ShapeInstances[Handle], InstanceTransform, true);
+	TooltipWidgetComponent->SetWorldLocation(InstanceTransform.GetLocation());
+
+	Execute_SelectPrimitive(this);
+}
+
+void AShpsShapesSpawner::UnselectShape(int32 Handle)
+{
+	if (!BalanceEngine.IsValidHandle(Handle))
+	{
+		return;
+	}
+
+	if (!bUseInstancedRendering)
+	{
+		Execute_UnselectPrimitive(ShapesArray[Handle]);
+	}
+	else if (Handle == SelectedHandle)
+	{
+		UnselectShapeInstance();
+	}
+}
+
+void AShpsShapesSpawner::SelectPrimitive_Implementation()
+{
+	TooltipWidgetComponent->SetVisibility(true);
+}
+
+void AShpsShapesSpawner::UnselectPrimitive_Implementation()
+{
+	TooltipWidgetComponent->SetVisibility(false);
+}
+
+FText AShpsShapesSpawner::GetType_Implementation()
+{
+	return BalanceEngine.IsValidHandle(SelectedHandle) ? GetPrimitiveTypeName(BalanceEngine.GetPrimitiveTypeId(SelectedHandle)) : FText::GetEmpty();
+}
+
+FText AShpsShapesSpawner::GetColor_Implementation()
+{
+	return BalanceEngine.IsValidHandle(SelectedHandle) ? GetColorName(BalanceEngine.GetColorId(SelectedHandle)) : FText::GetEmpty();
+}
+
+FText AShpsShapesSpawner::GetSize_Implementation()
+{
+	if (!BalanceEngine.IsValidHandle(SelectedHandle))
+	{
+		return FText::GetEmpty();
+	}
+
+	const int32 PrimitiveTypeId = BalanceEngine.GetPrimitiveTypeId(SelectedHandle);
+	FTransform InstanceTransform;
+	InstancedPrimitives[PrimitiveTypeId].Component->GetInstanceTransform(ShapeInstances[SelectedHandle], InstanceTransform, true);
+
+	return GetPrimitiveSizeText(PrimitiveTypeId, InstanceTransform.GetScale3D());
+}
+
+void AShpsShapesSpawner::PrecomputePendingSpawns()
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesPrecomputeSpawns);
+
+	FVector BoxLocation = BoxComponent->GetComponentLocation();
+	FVector BoxExtent = BoxComponent->GetUnscaledBoxExtent();
+	const FBox SpawnBox(BoxLocation - BoxExtent, BoxLocation + BoxExtent);
+	const float MaxRadius = PrimitiveCatalog.GetMaxRadius() * MaxSpawnScale;
+
+	//Chunking depends only on the field, not on the machine, so a seed gives the same field everywhere
+	int32 NumChunks = FMath::Max(PendingSpawns.Num() / MinSpawnsPerChunk, 1);
+	if (bPreventOverlaps && MaxRadius > 0.f)
+	{
+		//Every chunk fills its own slab along X, so it only has to check its own placements
+		NumChunks = FMath::Clamp(FMath::FloorToInt32(SpawnBox.GetSize().X / (MaxRadius * 4.f)), 1, NumChunks);
+	}
+
+	//Seeds are drawn up front so the result doesn't depend on which worker runs which chunk
+	TArray<int32> ChunkSeeds;
+	ChunkSeeds.SetNum(NumChunks);
+	for (int32& ChunkSeed : ChunkSeeds)
+	{
+		ChunkSeed = FieldRandomStream.RandHelper(MAX_int32);
+	}
+
+	ParallelFor(NumChunks, [this, &SpawnBox, &ChunkSeeds, NumChunks, MaxRadius](int32 ChunkIndex)
+	{
+		FBox ChunkBox = SpawnBox;
+		if (bPreventOverlaps && NumChunks > 1)
+		{
+			//Inner slab edges keep the largest radius free so neighbouring slabs can't overlap
+			const double SlabWidth = SpawnBox.GetSize().X / NumChunks;
+			ChunkBox.Min.X = SpawnBox.Min.X + SlabWidth * ChunkIndex + (ChunkIndex > 0 ? MaxRadius : 0.f);
+			ChunkBox.Max.X = SpawnBox.Min.X + SlabWidth * (ChunkIndex + 1) - (ChunkIndex < NumChunks - 1 ? MaxRadius : 0.f);
+		}
+
+		FRandomStream RandomStream(ChunkSeeds[ChunkIndex]);
+		FShpsPlacementGrid PlacementGrid;
+		PlacementGrid.Init(MaxRadius);
+
+		//Interleaved so every slab gets a mix of primitive types
+		for (int32 Index = ChunkIndex; Index < PendingSpawns.Num(); Index += NumChunks)
+		{
+			FShpsPendingSpawn& PendingSpawn = PendingSpawns[Index];
+			PendingSpawn.PrimitiveTypeId = Index / RandomNumber;
+			PendingSpawn.ColorId = Index % Colors.Num();
+			PendingSpawn.bPlaced = GetRandomSpawnTransform(PendingSpawn.PrimitiveTypeId, ChunkBox, RandomStream, PlacementGrid, PendingSpawn.Transform);
+		}
+	});
+
+	const int32 NumSkipped = PendingSpawns.FilterByPredicate([](const FShpsPendingSpawn& PendingSpawn) { return !PendingSpawn.bPlaced; }).Num();
+	if (NumSkipped > 0)
+	{
+		UE_LOG(LogShpsSpawner, Log, TEXT("%s found no free spot for %d of %d shapes, they are not spawned"), *GetName(), NumSkipped, PendingSpawns.Num());
+	}
+}
+
+bool AShpsShapesSpawner::GetRandomSpawnTransform(int32 PrimitiveTypeId, const FBox& SpawnBox, FRandomStream& RandomStream, FShpsPlacementGrid& PlacementGrid, FTransform& OutTransform) const
+{
+	float RandomSizeFloat = RandomStream.FRandRange(MinSpawnScale, MaxSpawnScale);
+
+	FVector RandomLocationInBox;
+	if (!bPreventOverlaps)
+	{
+		RandomLocationInBox = RandomStream.RandPointInBox(SpawnBox);
+	}
+	else
+	{
+		//Spawned shapes take the spawn scale as their world scale
+		const float Radius = PrimitiveCatalog.Get(PrimitiveTypeId).MeshBounds.SphereRadius;
+		if (!FindFreeLocation(SpawnBox, Radius * RandomSizeFloat, RandomStream, PlacementGrid, RandomLocationInBox))
+		{
+			bool bFoundAfterFallback = false;
+			if (PlacementFallback == EShpsPlacementFallback::ShrinkScale)
+			{
+				RandomSizeFloat = MinSpawnScale;
+				bFoundAfterFallback = FindFreeLocation(SpawnBox, Radius * RandomSizeFloat, RandomStream, PlacementGrid, RandomLocationInBox);
+			}
+
+			if (!bFoundAfterFallback && PlacementFallback != EShpsPlacementFallback::AllowOverlap)
+			{
+				return false;
+			}
+		}
+		PlacementGrid.Add(RandomLocationInBox, Radius * RandomSizeFloat);
+	}
+
+	OutTransform = FTransform::Identity;
+	OutTransform.SetLocation(RandomLocationInBox);
+	OutTransform.SetScale3D(FVector(RandomSizeFloat));
+
+	return true;
 }
 
-AShpsBaseShape* AShpsShapesSpawner::ChangePrimitiveType(const TSubclassOf<AShpsBaseShape>& PrimitiveType, AShpsBaseShape* Shape)
+bool AShpsShapesSpawner::FindFreeLocation(const FBox& SpawnBox, float Radius, FRandomStream& RandomStream, const FShpsPlacementGrid& PlacementGrid, FVector& OutLocation) const
 {
+	for (int Attempt = 0; Attempt < MaxPlacementAttempts; ++Attempt)
+	{
+		OutLocation = RandomStream.RandPointInBox(SpawnBox);
+		if (PlacementGrid.IsFree(OutLocation, Radius))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+FText AShpsShapesSpawner::GetPrimitiveSizeText(int32 PrimitiveTypeId, const FVector& WorldScale) const
+{
+	return PrimitiveCatalog.GetSizeText(PrimitiveTypeId, WorldScale);
+}
+
+void AShpsShapesSpawner::ChangePrimitiveType(int32 PrimitiveTypeId, AShpsBaseShape* Shape)
+{
+	Shape->SetPrimitiveType(PrimitiveTypeId, PrimitiveCatalog.Get(PrimitiveTypeId));
+}
+
+AShpsBaseShape* AShpsShapesSpawner::AcquireShape(int32 PrimitiveTypeId, const FTransform& SpawnTransform)
+{
+	//A pooled shape of another type is retyped rather than spawning a new actor
+	int32 PoolId = PrimitiveTypeId;
+	if (!ShapePools.IsValidIndex(PoolId) || ShapePools[PoolId].Shapes.Num() == 0)
+	{
+		PoolId = ShapePools.IndexOfByPredicate([](const FShpsShapePool& ShapePool) { return ShapePool.Shapes.Num() > 0; });
+	}
+
+	if (PoolId != INDEX_NONE)
+	{
+		TObjectPtr<AShpsBaseShape> PooledShape = ShapePools[PoolId].Shapes.Pop(EAllowShrinking::No);
+		DEC_DWORD_STAT(STAT_ShapesPooled);
+		if (PoolId != PrimitiveTypeId)
+		{
+			ChangePrimitiveType(PrimitiveTypeId, PooledShape);
+		}
+		PooledShape->SetActorTransform(SpawnTransform);
+		PooledShape->SetShapeActive(true);
+		return PooledShape;
+	}
+
 	TObjectPtr<UWorld> World = GetWorld();
 	if (World)
 	{
 		FActorSpawnParameters SpawnParams;
 		SpawnParams.Owner = this;
-		
-		FTransform SpawnTransform;
-		SpawnTransform.SetLocation(Shape->GetActorLocation());
-		SpawnTransform.SetScale3D(Shape->GetActorScale());
 
-		AShpsBaseShape* SpawnedShape = World->SpawnActor<AShpsBaseShape>(PrimitiveType, SpawnTransform, SpawnParams);
+		AShpsBaseShape* SpawnedShape = World->SpawnActor<AShpsBaseShape>(PrimitiveCatalog.Get(PrimitiveTypeId).ShapeClass, SpawnTransform, SpawnParams);
 		if (SpawnedShape)
 		{
+			SpawnedShape->SetPrimitiveTypeInfo(PrimitiveTypeId);
 			return SpawnedShape;
 		}
 	}
 	return nullptr;
 }
 
-void AShpsShapesSpawner::AddColorsToShapes(TArray<AShpsBaseShape*> Shapes, const TMap<FLinearColor, FText>& Colors)
+void AShpsShapesSpawner::ReleaseShape(AShpsBaseShape* Shape)
 {
-	int Index = 0;
-	TArray<FLinearColor> ColorsArray;
-	Colors.GenerateKeyArray(ColorsArray);
-	
-	for (auto& Shape : Shapes)
+	Shape->SetShapeActive(false);
+	Shape->SetShapeHandle(INDEX_NONE);
+	ShapePools[Shape->GetPrimitiveTypeId()].Shapes.Add(Shape);
+	INC_DWORD_STAT(STAT_ShapesPooled);
+}
+
+void AShpsShapesSpawner::PrewarmShapePools()
+{
+	ShapePools.SetNum(PrimitiveCatalog.Num());
+
+	TObjectPtr<UWorld> World = GetWorld();
+	if (!World)
 	{
-		TObjectPtr<UStaticMeshComponent> ShapeMeshComponent = Cast<UStaticMeshComponent>(Shape->GetComponentByClass(UStaticMeshComponent::StaticClass()));
-		if (ShapeMeshComponent)
+		return;
+	}
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.Owner = this;
+
+	for (int32 PrimitiveTypeId = 0; PrimitiveTypeId < PrimitiveCatalog.Num(); ++PrimitiveTypeId)
+	{
+		for (int i = ShapePools[PrimitiveTypeId].Shapes.Num(); i < PoolPrewarmNumber; i++)
 		{
-			Material = ShapeMeshComponent->GetMaterial(0);
-			if (Material)
+			AShpsBaseShape* SpawnedShape = World->SpawnActor<AShpsBaseShape>(PrimitiveCatalog.Get(PrimitiveTypeId).ShapeClass, GetActorTransform(), SpawnParams);
+			if (SpawnedShape)
 			{
-				Shape->ShapeMaterialInstanceDynamic = UMaterialInstanceDynamic::Create(Material, Shape);
-				
-				if (Shape->ShapeMaterialInstanceDynamic)
-				{
-					ShapeMeshComponent->SetMaterial(0, Shape->ShapeMaterialInstanceDynamic);
-					
-					int ColorsArrayIndex = Index % ColorsArray.Num();
-					Shape->ShapeMaterialInstanceDynamic->SetVectorParameterValue(FName("Color"), ColorsArray[ColorsArrayIndex]);
-					Shape->SetPrimitiveColorInfo(ColorsArray[ColorsArrayIndex], Colors);
-					++Index;
-				}
-				
+				SpawnedShape->SetPrimitiveTypeInfo(PrimitiveTypeId);
+				ReleaseShape(SpawnedShape);
 			}
 		}
 	}
 }
 
-void AShpsShapesSpawner::AddColorToShape(AShpsBaseShape* BaseShape, const FLinearColor& Color)
+void AShpsShapesSpawner::AddColorToShape(AShpsBaseShape* BaseShape, int32 ColorId)
 {
-	if (!BaseShape->ShapeMaterialInstanceDynamic)
+	SCOPE_CYCLE_COUNTER(STAT_ShapesAssignMaterial);
+
+	TObjectPtr<UStaticMeshComponent> ShapeMeshComponent = BaseShape->GetStaticMeshComponent();
+	if (ShapeMeshComponent)
 	{
-		TObjectPtr<UStaticMeshComponent> ShapeMeshComponent = Cast<UStaticMeshComponent>(BaseShape->GetComponentByClass(UStaticMeshComponent::StaticClass()));
-		if (ShapeMeshComponent)
+		TObjectPtr<UMaterialInstanceDynamic> ColorMaterial = GetColorMaterial(BaseShape->GetBaseMaterial(), ColorId);
+		if (ColorMaterial && ShapeMeshComponent->GetMaterial(0) != ColorMaterial)
 		{
-			Material = ShapeMeshComponent->GetMaterial(0);
-			if (Material)
-			{
-				BaseShape->ShapeMaterialInstanceDynamic = UMaterialInstanceDynamic::Create(Material, BaseShape);
-				
-				if (BaseShape->ShapeMaterialInstanceDynamic)
-				{
-					ShapeMeshComponent->SetMaterial(0, BaseShape->ShapeMaterialInstanceDynamic);
-					
-					BaseShape->ShapeMaterialInstanceDynamic->SetVectorParameterValue(FName("Color"), Color);
-				}
-				
-			}
+			ShapeMeshComponent->SetMaterial(0, ColorMaterial);
 		}
 	}
-	else
+}
+
+UMaterialInstanceDynamic* AShpsShapesSpawner::GetColorMaterial(UMaterialInterface* BaseMaterial, int32 ColorId)
+{
+	if (!BaseMaterial)
+	{
+		return nullptr;
+	}
+
+	//One shared instance per base material and color, shapes only swap which one they point at
+	FShpsColorMaterials& ColorMaterials = ColorMaterialsCache.FindOrAdd(BaseMaterial);
+	if (ColorMaterials.Instances.Num() < Colors.Num())
 	{
-		BaseShape->ShapeMaterialInstanceDynamic->SetVectorParameterValue(FName("Color"), Color);
+		ColorMaterials.Instances.SetNum(Colors.Num());
 	}
+
+	TObjectPtr<UMaterialInstanceDynamic>& ColorMaterial = ColorMaterials.Instances[ColorId];
+	if (!ColorMaterial)
+	{
+		ColorMaterial = UMaterialInstanceDynamic::Create(BaseMaterial, this);
+		if (ColorMaterial)
+		{
+			ColorMaterial->SetVectorParameterValue(ColorParameterName, Colors[ColorId]);
+			INC_DWORD_STAT(STAT_ShapesColorMIDs);
+		}
+	}
+
+	return ColorMaterial;
 }
 
-void AShpsShapesSpawner::OnRandomNumberGenerated(int Number)
+void AShpsShapesSpawner::LoadPrimitiveTypes()
 {
-	RandomNumber = Number;
+	TArray<FSoftObjectPath> PrimitiveClassPaths;
+	for (const auto& Primitive : PrimitivesMap)
+	{
+		PrimitiveClassPaths.Add(Primitive.Key.ToSoftObjectPath());
+	}
 
-	InitSpawner();
-	UpdatePrimitivesNumMap(PrimitivesNumMap);
-	UpdateColorsNumMap(ColorsNumMap);
+	//Shape classes pull in their meshes and materials, none of it blocks the game thread
+	PrimitiveTypesHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(PrimitiveClassPaths, FStreamableDelegate::CreateUObject(this, &AShpsShapesSpawner::OnPrimitiveTypesLoaded));
+	if (!PrimitiveTypesHandle.IsValid())
+	{
+		OnPrimitiveTypesLoaded();
+	}
 }
 
-void AShpsShapesSpawner::InitSpawner()
+void AShpsShapesSpawner::OnPrimitiveTypesLoaded()
 {
-	for (auto& Primitive : PrimitivesMap)
+	for (const auto& Primitive : PrimitivesMap)
 	{
-		for (int i = 0; i < RandomNumber; i++)
+		TSubclassOf<AShpsBaseShape> PrimitiveType = Primitive.Key.Get();
+		if (!PrimitiveType)
 		{
-			TObjectPtr<AShpsBaseShape> SpawnedShape = SpawnShapeInRandomLocAndSize(Primitive.Key);
-			ShapesArray.Add(SpawnedShape);
-			SpawnedShape->SetPrimitiveTypeInfo(Primitive.Key, PrimitivesMap);
-			SpawnedShape->SetPrimitiveSizeInfo();
+			UE_LOG(LogShpsSpawner, Warning, TEXT("Couldn't load primitive type %s"), *Primitive.Key.ToString());
+			continue;
 		}
+
+		PrimitiveCatalog.Add(PrimitiveType, Primitive.Value);
 	}
 
-	AddColorsToShapes(ShapesArray, ColorsMap);
+	bPrimitiveTypesLoaded = true;
+	StartSpawning();
 }
 
-bool AShpsShapesSpawner::SameNumberOfEachPrimitive(TMap<FString, int>& PrimitivesNum)
+void AShpsShapesSpawner::OnRandomNumberGenerated(int Number, FRandomStream& GameRandomStream)
 {
-	for (const auto& PrimitiveNum : PrimitivesNum)
+	RandomNumber = Number;
+	FieldRandomStream.Initialize(GameRandomStream.RandHelper(MAX_int32));
+
+	bRandomNumberGenerated = true;
+	StartSpawning();
+}
+
+void AShpsShapesSpawner::StartSpawning()
+{
+	//Waits for both the shape count and the primitive classes, whichever comes last starts the field
+	if (!bRandomNumberGenerated || !bPrimitiveTypesLoaded)
+	{
+		return;
+	}
+
+	//An instance can't be retyped to a type without a mesh, the balance would keep planning the same moves
+	if (bUseInstancedRendering)
 	{
-		for (const auto& PrimitiveNum2 : PrimitivesNum)
-			if (PrimitiveNum.Value != PrimitiveNum2.Value)
+		for (int32 PrimitiveTypeId = 0; PrimitiveTypeId < PrimitiveCatalog.Num(); ++PrimitiveTypeId)
+		{
+			if (!PrimitiveCatalog.Get(PrimitiveTypeId).Mesh)
 			{
-				return false;
+				UE_LOG(LogShpsSpawner, Warning, TEXT("%s has no mesh for primitive type %s, spawning shape actors instead of instances"),
+					*GetName(), *PrimitiveCatalog.Get(PrimitiveTypeId).DisplayName.ToString());
+				bUseInstancedRendering = false;
+				break;
 			}
+		}
 	}
-	
-	return true;
+
+	InitShapeIndex();
+	if (bUseGlobalBalance && SpawnerSubsystem)
+	{
+		bInGlobalBalance = SpawnerSubsystem->JoinGlobalBalance(this);
+	}
+	if (!bUseInstancedRendering)
+	{
+		PrewarmShapePools();
+	}
+	InitSpawner();
 }
 
-bool AShpsShapesSpawner::SameNumberOfEachColor(TMap<FString, int>& ColorsNum)
+void AShpsShapesSpawner::InitSpawner()
 {
-	for (const auto& ColorNum : ColorsNum)
+	SCOPE_CYCLE_COUNTER(STAT_ShapesInitSpawner);
+
+	//Colors are assigned round robin, an empty ColorsMap would divide by zero
+	if (Colors.Num() == 0 || PrimitiveCatalog.Num() == 0)
 	{
-		for (const auto& ColorNum2 : ColorsNum)
-			if (ColorNum.Value != ColorNum2.Value)
-			{
-				return false;
-			}
+		UE_LOG(LogShpsSpawner, Warning, TEXT("%s has no colors or no loaded primitive types, nothing is spawned"), *GetName());
+		return;
+	}
+
+	if (bUseInstancedRendering)
+	{
+		InitInstancedPrimitives();
+	}
+
+	bFieldReady = false;
+	PendingSpawns.Reset();
+	PendingSpawns.SetNum(PrimitiveCatalog.Num() * RandomNumber);
+	NextPendingSpawn = 0;
+
+	//Types, colors and transforms are worked out up front, the queue below only spawns
+	PrecomputePendingSpawns();
+
+	//First batch goes out right away, the rest is spawned from Tick
+	SpawnPendingShapes();
+	if (!bFieldReady)
+	{
+		SetActorTickEnabled(true);
 	}
-	
-	return true;
 }
 
-TArray<FString> AShpsShapesSpawner::PrimitivesTypeAboveToleranceNumber(TMap<FString, int>& PrimitivesNum, FText& DestroyedPrimitiveType)
+void AShpsShapesSpawner::SpawnPendingShapes()
 {
-	TArray<FString> PrimitiveTypeOverrepresentedArray;
-	UpdatePrimitivesNumMap(PrimitivesNumMap);
-	
-	for (const auto& PrimitiveNum : PrimitivesNum)
+	SCOPE_CYCLE_COUNTER(STAT_ShapesSpawnPendingShapes);
+
+	const double EndTime = FPlatformTime::Seconds() + SpawnTimeBudgetMs * 0.001;
+
+	int SpawnedThisFrame = 0;
+	while (NextPendingSpawn < PendingSpawns.Num())
 	{
-		if (abs((PrimitiveNum.Value - (*PrimitivesNum.Find(DestroyedPrimitiveType.ToString())))) > ToleranceNumber)
+		SpawnPendingShape(PendingSpawns[NextPendingSpawn]);
+		++NextPendingSpawn;
+		++SpawnedThisFrame;
+
+		if (SpawnedThisFrame >= MaxSpawnsPerFrame || FPlatformTime::Seconds() >= EndTime)
 		{
-			PrimitiveTypeOverrepresentedArray.Add(PrimitiveNum.Key);
+			break;
 		}
 	}
 
-	return PrimitiveTypeOverrepresentedArray;
+	if (NextPendingSpawn < PendingSpawns.Num())
+	{
+		return;
+	}
+
+	PendingSpawns.Empty();
+	NextPendingSpawn = 0;
+	bFieldReady = true;
+	FieldReadyTime = GetWorld()->GetTimeSeconds();
+	SetActorTickEnabled(false);
+
+	if (bRecordingHits)
+	{
+		HitRecording.Reset(BalanceEngine.GetShapeIndex().GetNumHandles(), FieldRandomStream.GetInitialSeed());
+	}
+
+	OnFieldReadyDelegate.Broadcast();
+
+	//Shapes shot while the field was still spawning
+	if (bInGlobalBalance)
+	{
+		SpawnerSubsystem->OnSpawnerFieldReady(this);
+	}
+	else if (bRebalanceDeferred)
+	{
+		bRebalanceDeferred = false;
+		QueueRebalance();
+	}
+
+	StartHitReplay();
 }
 
-TArray<FString> AShpsShapesSpawner::ColorsAboveToleranceNumber(TMap<FString, int>& ColorsNum, FText& DestroyedPrimitiveColor)
+void AShpsShapesSpawner::SpawnPendingShape(const FShpsPendingSpawn& PendingSpawn)
 {
-	TArray<FString> PrimitiveColorOverrepresentedArray;
-	UpdateColorsNumMap(ColorsNumMap);
-	
-	for (const auto& ColorNum : ColorsNum)
+	if (!PendingSpawn.bPlaced)
 	{
-		if (abs((ColorNum.Value - (*ColorsNum.Find(DestroyedPrimitiveColor.ToString())))) > ToleranceNumber)
-		{
-			PrimitiveColorOverrepresentedArray.Add(ColorNum.Key);
-		}
+		return;
+	}
+
+	if (bUseInstancedRendering)
+	{
+		AddInstancedShape(PendingSpawn.PrimitiveTypeId, PendingSpawn.ColorId, PendingSpawn.Transform);
+		return;
 	}
 
-	return PrimitiveColorOverrepresentedArray;
+	TObjectPtr<AShpsBaseShape> SpawnedShape = AcquireShape(PendingSpawn.PrimitiveTypeId, PendingSpawn.Transform);
+	if (SpawnedShape)
+	{
+		AddColorToShape(SpawnedShape, PendingSpawn.ColorId);
+		SpawnedShape->SetPrimitiveColorInfo(PendingSpawn.ColorId);
+		RegisterShape(SpawnedShape);
+	}
 }
 
-UE_DISABLE_OPTIMIZATION
+void AShpsShapesSpawner::InitShapeIndex()
+{
+	BalanceEngine.Init(PrimitiveCatalog.Num(), Colors.Num(), ToleranceNumber);
+	ShapesArray.Reset();
+	ShapeInstances.Reset();
+}
 
-void AShpsShapesSpawner::UpdatePrimitivesNumMap(TMap<FString, int>& PrimitivesNum)
+void AShpsShapesSpawner::RegisterShape(AShpsBaseShape* Shape)
 {
-	for (auto& Primitive : PrimitivesMap)
+	const int32 Handle = AddBalancedShape(Shape->GetPrimitiveTypeId(), Shape->GetPrimitiveColorId());
+	if (!ShapesArray.IsValidIndex(Handle))
+	{
+		ShapesArray.SetNum(Handle + 1);
+	}
+	ShapesArray[Handle] = Shape;
+	Shape->SetShapeHandle(Handle);
+	INC_DWORD_STAT(STAT_ShapesLive);
+
+	if (SelectionSubsystem)
 	{
-		int Index = 0;
-		for (auto& Shape : ShapesArray)
+		SelectionSubsystem->AddShape(this, Handle, GetShapeBounds(Shape->GetPrimitiveTypeId(), Shape->GetActorTransform()));
+	}
+}
+
+void AShpsShapesSpawner::UnregisterShape(AShpsBaseShape* Shape)
+{
+	const int32 Handle = Shape->GetShapeHandle();
+	if (BalanceEngine.IsValidHandle(Handle))
+	{
+		RemoveBalancedShape(Handle);
+		ShapesArray[Handle] = nullptr;
+		Shape->SetShapeHandle(INDEX_NONE);
+		DEC_DWORD_STAT(STAT_ShapesLive);
+
+		if (SelectionSubsystem)
 		{
-			if (Primitive.Value.EqualTo(Shape->GetPrimitiveType()))
-			{
-				++Index;
-				PrimitivesNum.Add(Shape->GetPrimitiveType().ToString(), Index);
-			}
+			SelectionSubsystem->RemoveShape(this, Handle);
 		}
-		if (Index == 0)
+	}
+}
+
+void AShpsShapesSpawner::ChangeShapeCategory(int32 Handle, int32 PrimitiveTypeId, int32 ColorId)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesChangeShapeCategory);
+
+	if (bUseInstancedRendering)
+	{
+		ChangeInstancedShapeCategory(Handle, PrimitiveTypeId, ColorId);
+		return;
+	}
+
+	TObjectPtr<AShpsBaseShape> Shape = ShapesArray[Handle];
+	if (Shape->GetPrimitiveTypeId() != PrimitiveTypeId)
+	{
+		ChangePrimitiveType(PrimitiveTypeId, Shape);
+
+		if (SelectionSubsystem)
 		{
-			PrimitivesNum.Add(Primitive.Value.ToString(), Index);
+			SelectionSubsystem->UpdateShape(this, Handle, GetShapeBounds(PrimitiveTypeId, Shape->GetActorTransform()));
 		}
 	}
+
+	AddColorToShape(Shape, ColorId);
+	Shape->SetPrimitiveColorInfo(ColorId);
+	MoveBalancedShape(Handle, PrimitiveTypeId, ColorId);
+}
+
+void AShpsShapesSpawner::ApplyBalanceChange(int32 Handle, int32 PrimitiveTypeId, int32 ColorId)
+{
+	if (BalanceEngine.IsValidHandle(Handle))
+	{
+		ChangeShapeCategory(Handle, PrimitiveTypeId, ColorId);
+	}
 }
-UE_ENABLE_OPTIMIZATION
 
-void AShpsShapesSpawner::UpdateColorsNumMap(TMap<FString, int>& ColorsNum)
+int32 AShpsShapesSpawner::AddBalancedShape(int32 PrimitiveTypeId, int32 ColorId)
 {
-	for (auto& Color : ColorsMap)
+	SCOPE_CYCLE_COUNTER(STAT_ShapesUpdateCounts);
+
+	const int32 Handle = BalanceEngine.AddShape(PrimitiveTypeId, ColorId);
+	if (bInGlobalBalance)
 	{
-		int Index = 0;
-		for (auto& Shape : ShapesArray)
+		SpawnerSubsystem->AddGlobalShape(this, Handle, PrimitiveTypeId, ColorId);
+	}
+	return Handle;
+}
+
+void AShpsShapesSpawner::RemoveBalancedShape(int32 Handle)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesUpdateCounts);
+
+	BalanceEngine.RemoveShape(Handle);
+	if (bInGlobalBalance)
+	{
+		SpawnerSubsystem->RemoveGlobalShape(this, Handle);
+	}
+}
+
+void AShpsShapesSpawner::MoveBalancedShape(int32 Handle, int32 PrimitiveTypeId, int32 ColorId)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesUpdateCounts);
+
+	BalanceEngine.MoveShape(Handle, PrimitiveTypeId, ColorId);
+	if (bInGlobalBalance)
+	{
+		SpawnerSubsystem->MoveGlobalShape(this, Handle, PrimitiveTypeId, ColorId);
+	}
+}
+
+void AShpsShapesSpawner::InitInstancedPrimitives()
+{
+	InstancedPrimitives.SetNum(PrimitiveCatalog.Num());
+
+	for (int32 PrimitiveTypeId = 0; PrimitiveTypeId < PrimitiveCatalog.Num(); ++PrimitiveTypeId)
+	{
+		FShpsInstancedPrimitive& InstancedPrimitive = InstancedPrimitives[PrimitiveTypeId];
+		if (InstancedPrimitive.Component)
 		{
-			if (Color.Value.EqualTo(Shape->GetPrimitiveColor()))
-			{
-				++Index;
-				ColorsNum.Add(Shape->GetPrimitiveColor().ToString(), Index);
-			}
+			continue;
 		}
-		if (Index == 0)
+
+		const FShpsPrimitiveEntry& PrimitiveEntry = PrimitiveCatalog.Get(PrimitiveTypeId);
+		if (!PrimitiveEntry.Mesh)
 		{
-			ColorsNum.Add(Color.Value.ToString(), Index);
+			continue;
 		}
+
+		TObjectPtr<UInstancedStaticMeshComponent> Component = NewObject<UInstancedStaticMeshComponent>(this);
+		Component->BodyInstance.CopyBodyInstancePropertiesFrom(&PrimitiveEntry.BodyInstance);
+		Component->SetStaticMesh(PrimitiveEntry.Mesh);
+		Component->SetMaterial(0, InstancedMaterial);
+		Component->SetNumCustomDataFloats(3);
+		Component->SetupAttachment(RootComponent);
+		Component->RegisterComponent();
+
+		InstancedPrimitive.Component = Component;
 	}
 }
 
-const FString* AShpsShapesSpawner::GetPrimitiveTypeLargestQuantity() const
+int32 AShpsShapesSpawner::AcquireInstance(int32 PrimitiveTypeId, const FTransform& InstanceTransform, int32 Handle)
 {
-	int ResultPrimitiveMax = *PrimitivesNumMap.Find(ShapesArray[0]->GetPrimitiveType().ToString());
-	for (const auto& Primitive : PrimitivesNumMap)
+	FShpsInstancedPrimitive& InstancedPrimitive = InstancedPrimitives[PrimitiveTypeId];
+
+	int32 InstanceIndex;
+	if (InstancedPrimitive.FreeInstances.Num() > 0)
+	{
+		InstanceIndex = InstancedPrimitive.FreeInstances.Pop(EAllowShrinking::No);
+		InstancedPrimitive.Component->UpdateInstanceTransform(InstanceIndex, InstanceTransform, true, true, true);
+	}
+	else
 	{
-		if (ResultPrimitiveMax < Primitive.Value)
+		InstanceIndex = InstancedPrimitive.Component->AddInstance(InstanceTransform, true);
+		if (!InstancedPrimitive.InstanceHandles.IsValidIndex(InstanceIndex))
 		{
-			ResultPrimitiveMax = Primitive.Value;
+			InstancedPrimitive.InstanceHandles.SetNum(InstanceIndex + 1);
 		}
 	}
-	const FString* PrimitiveMaxTypeString = PrimitivesNumMap.FindKey(ResultPrimitiveMax);
-	
-	return PrimitiveMaxTypeString;
+
+	InstancedPrimitive.InstanceHandles[InstanceIndex] = Handle;
+	return InstanceIndex;
 }
 
-const FString* AShpsShapesSpawner::GetPrimitiveTypeLeastQuantity() const
+void AShpsShapesSpawner::ReleaseInstance(int32 PrimitiveTypeId, int32 InstanceIndex)
 {
-	int ResultPrimitiveMin = *PrimitivesNumMap.Find(ShapesArray[0]->GetPrimitiveType().ToString());
-	for (const auto& Primitive : PrimitivesNumMap)
+	FShpsInstancedPrimitive& InstancedPrimitive = InstancedPrimitives[PrimitiveTypeId];
+
+	//Zero scale hides the instance and drops its physics body, removing it would shift the other instance indices
+	FTransform InstanceTransform;
+	InstancedPrimitive.Component->GetInstanceTransform(InstanceIndex, InstanceTransform, true);
+	InstanceTransform.SetScale3D(FVector::ZeroVector);
+	InstancedPrimitive.Component->UpdateInstanceTransform(InstanceIndex, InstanceTransform, true, true, true);
+
+	InstancedPrimitive.InstanceHandles[InstanceIndex] = INDEX_NONE;
+	InstancedPrimitive.FreeInstances.Add(InstanceIndex);
+}
+
+void AShpsShapesSpawner::SetInstanceColor(int32 PrimitiveTypeId, int32 InstanceIndex, int32 ColorId)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesAssignMaterial);
+
+	const FLinearColor& Color = Colors[ColorId];
+	const float ColorData[] = { Color.R, Color.G, Color.B };
+	InstancedPrimitives[PrimitiveTypeId].Component->SetCustomData(InstanceIndex, MakeArrayView(ColorData), true);
+}
+
+int32 AShpsShapesSpawner::AddInstancedShape(int32 PrimitiveTypeId, int32 ColorId, const FTransform& InstanceTransform)
+{
+	if (!InstancedPrimitives[PrimitiveTypeId].Component)
 	{
-		if (ResultPrimitiveMin > Primitive.Value)
-		{
-			ResultPrimitiveMin = Primitive.Value;
-		}
+		return INDEX_NONE;
+	}
+
+	const int32 Handle = AddBalancedShape(PrimitiveTypeId, ColorId);
+	if (!ShapeInstances.IsValidIndex(Handle))
+	{
+		ShapeInstances.SetNum(Handle + 1);
 	}
-	const FString* PrimitiveMinTypeString = PrimitivesNumMap.FindKey(ResultPrimitiveMin);
+	ShapeInstances[Handle] = AcquireInstance(PrimitiveTypeId, InstanceTransform, Handle);
+	SetInstanceColor(PrimitiveTypeId, ShapeInstances[Handle], ColorId);
+	INC_DWORD_STAT(STAT_ShapesLive);
 
-	return PrimitiveMinTypeString;
+	if (SelectionSubsystem)
+	{
+		SelectionSubsystem->AddShape(this, Handle, GetShapeBounds(PrimitiveTypeId, InstanceTransform));
+	}
+
+	return Handle;
 }
 
-const FString* AShpsShapesSpawner::GetColorLargestQuantity() const
+void AShpsShapesSpawner::RemoveInstancedShape(int32 Handle)
 {
-	int ResultColorMax = *ColorsNumMap.Find(ShapesArray[0]->GetPrimitiveColor().ToString());
-	for (const auto& Color : ColorsNumMap)
+	if (Handle == SelectedHandle)
+	{
+		UnselectShapeInstance();
+	}
+
+	const int32 PrimitiveTypeId = BalanceEngine.GetPrimitiveTypeId(Handle);
+
+	ReleaseInstance(PrimitiveTypeId, ShapeInstances[Handle]);
+	ShapeInstances[Handle] = INDEX_NONE;
+	RemoveBalancedShape(Handle);
+	DEC_DWORD_STAT(STAT_ShapesLive);
+
+	if (SelectionSubsystem)
 	{
-		if (ResultColorMax < Color.Value)
+		SelectionSubsystem->RemoveShape(this, Handle);
+	}
+}
+
+void AShpsShapesSpawner::ChangeInstancedShapeCategory(int32 Handle, int32 PrimitiveTypeId, int32 ColorId)
+{
+	const int32 OldPrimitiveTypeId = BalanceEngine.GetPrimitiveTypeId(Handle);
+	int32 InstanceIndex = ShapeInstances[Handle];
+
+	//A retype moves the instance to the component of the new primitive type at the same transform
+	if (OldPrimitiveTypeId != PrimitiveTypeId)
+	{
+		if (!InstancedPrimitives[PrimitiveTypeId].Component)
+		{
+			return;
+		}
+
+		FTransform InstanceTransform;
+		InstancedPrimitives[OldPrimitiveTypeId].Component->GetInstanceTransform(InstanceIndex, InstanceTransform, true);
+		ReleaseInstance(OldPrimitiveTypeId, InstanceIndex);
+
+		InstanceIndex = AcquireInstance(PrimitiveTypeId, InstanceTransform, Handle);
+		ShapeInstances[Handle] = InstanceIndex;
+
+		if (SelectionSubsystem)
 		{
-			ResultColorMax = Color.Value;
+			SelectionSubsystem->UpdateShape(this, Handle, GetShapeBounds(PrimitiveTypeId, InstanceTransform));
 		}
 	}
-	const FString* ColorMaxString = ColorsNumMap.FindKey(ResultColorMax);
 
-	return ColorMaxString;
+	SetInstanceColor(PrimitiveTypeId, InstanceIndex, ColorId);
+	MoveBalancedShape(Handle, PrimitiveTypeId, ColorId);
 }
 
-const FString* AShpsShapesSpawner::GetColorLeastQuantity() const
+int32 AShpsShapesSpawner::FindInstanceHandle(const UPrimitiveComponent* Component, int32 InstanceIndex) const
 {
-	int ResultColorMin = *ColorsNumMap.Find(ShapesArray[0]->GetPrimitiveColor().ToString());
-	for (const auto& Color : ColorsNumMap)
+	for (const FShpsInstancedPrimitive& InstancedPrimitive : InstancedPrimitives)
 	{
-		if (ResultColorMin > Color.Value)
+		if (InstancedPrimitive.Component == Component)
 		{
-			ResultColorMin = Color.Value;
+			return InstancedPrimitive.InstanceHandles.IsValidIndex(InstanceIndex) ? InstancedPrimitive.InstanceHandles[InstanceIndex] : INDEX_NONE;
 		}
 	}
-	const FString* ColorMinString = ColorsNumMap.FindKey(ResultColorMin);
+	return INDEX_NONE;
+}
 
-	return ColorMinString;
+FBoxSphereBounds AShpsShapesSpawner::GetShapeBounds(int32 PrimitiveTypeId, const FTransform& ShapeTransform) const
+{
+	return PrimitiveCatalog.Get(PrimitiveTypeId).MeshBounds.TransformBy(ShapeTransform);
 }
 
-TTuple<TObjectPtr<AShpsBaseShape>, TObjectPtr<AShpsBaseShape>> AShpsShapesSpawner::AdjustColors()
+void AShpsShapesSpawner::QueueRebalance()
 {
-	bool ColorIsChanged = false;
-	for (const auto& Shape : ShapesArray)
+	if (bRebalanceQueued)
 	{
-		if (Shape->GetPrimitiveColor().ToString().Equals(*GetColorLargestQuantity()) && !ColorIsChanged)
-		{
-			const FLinearColor* ColorToChange = ColorsMapString.FindKey(*GetColorLeastQuantity());
+		return;
+	}
+	bRebalanceQueued = true;
+
+	//Every hit until then is folded into the same rebalance
+	if (RebalanceInterval > 0.f)
+	{
+		GetWorldTimerManager().SetTimer(RebalanceTimerHandle, this, &AShpsShapesSpawner::RebalanceAfterShapeRemoved, RebalanceInterval, false);
+	}
+	else
+	{
+		RebalanceTimerHandle = GetWorldTimerManager().SetTimerForNextTick(this, &AShpsShapesSpawner::RebalanceAfterShapeRemoved);
+	}
+}
 
-			TObjectPtr<AShpsBaseShape> ShapeToDelete = Shape;
-											
-			AddColorToShape(Shape, *ColorToChange);
-			ColorIsChanged = true;
-			Shape->SetPrimitiveColorInfo(*ColorToChange, ColorsMap);
+void AShpsShapesSpawner::RebalanceAfterShapeRemoved()
+{
+	bRebalanceQueued = false;
 
-			TObjectPtr<AShpsBaseShape> ShapeToAdd = Shape;
-			
-			return MakeTuple(ShapeToDelete, ShapeToAdd);
-		}
+	//Counters only cover the shapes spawned so far while the queue is still draining, it runs again once the field is ready
+	if (!bFieldReady)
+	{
+		bRebalanceDeferred = true;
+		return;
 	}
-	return MakeTuple(nullptr, nullptr);
+
+	SCOPE_CYCLE_COUNTER(STAT_ShapesRebalance);
+
+	BalanceEngine.PlanRebalance(BalanceChanges);
+	if (BalanceChanges.Num() == 0)
+	{
+		return;
+	}
+
+	//Planned against the counts before any of them is applied, handles stay valid while the batch runs
+	for (const FShpsBalanceChange& Change : BalanceChanges)
+	{
+		ChangeShapeCategory(Change.Handle, Change.PrimitiveTypeId, Change.ColorId);
+	}
+	BalanceChanges.Reset();
+
+	CountRebalance();
 }
 
-TTuple<TObjectPtr<AShpsBaseShape>, TObjectPtr<AShpsBaseShape>> AShpsShapesSpawner::AdjustPrimitiveType()
+void AShpsShapesSpawner::CountRebalance()
 {
-	bool PrimitiveIsChanged = false;
-	for (const auto& Shape : ShapesArray)
+	INC_DWORD_STAT(STAT_ShapesRebalances);
+	++RebalancesSinceLastSample;
+}
+
+void AShpsShapesSpawner::UpdateRebalanceRateStat()
+{
+	//Accumulated across spawners, so only this spawner's change is applied
+	const float RebalanceRate = RebalancesSinceLastSample / RebalanceRateSampleInterval;
+	INC_FLOAT_STAT_BY(STAT_ShapesRebalancesPerSecond, RebalanceRate - ReportedRebalanceRate);
+	ReportedRebalanceRate = RebalanceRate;
+	RebalancesSinceLastSample = 0;
+}
+
+void AShpsShapesSpawner::ShootShape(int32 Handle)
+{
+	SCOPE_CYCLE_COUNTER(STAT_ShapesShapeShooted);
+
+	if (!BalanceEngine.IsValidHandle(Handle))
 	{
-		if (Shape->GetPrimitiveType().ToString().Equals(*GetPrimitiveTypeLargestQuantity()) && !PrimitiveIsChanged)
-		{
-			const TSubclassOf<AShpsBaseShape> ShapeToChange = *PrimitivesMapString.FindKey(*GetPrimitiveTypeLeastQuantity());
-			const FLinearColor* ShapeColor = ColorsMapString.FindKey(Shape->GetPrimitiveColor().ToString());
-
-			AShpsBaseShape* NewShape = ChangePrimitiveType(ShapeToChange, Shape);
-			NewShape->SetPrimitiveTypeInfo(NewShape->GetClass(), PrimitivesMap);
-			NewShape->SetPrimitiveSizeInfo();
-												
-			AddColorToShape(NewShape, *ShapeColor);
-			NewShape->SetPrimitiveColorInfo(*ShapeColor, ColorsMap);
-
-			TObjectPtr<AShpsBaseShape> ShapeToDelete = Shape;
-			TObjectPtr<AShpsBaseShape> ShapeToAdd = NewShape;
-			Shape->Destroy();
-												
-			PrimitiveIsChanged = true;
-
-			return MakeTuple(ShapeToDelete, ShapeToAdd);
-		}
+		return;
+	}
+
+	//Freed handles are reused by the shapes still to spawn, so hits before the field is ready would make a recorded field differ from its replay
+	if (!bFieldReady && (bRecordingHits || !HitReplayName.IsEmpty()))
+	{
+		return;
+	}
+
+	if (bRecordingHits)
+	{
+		HitRecording.Add(Handle, GetWorld()->GetTimeSeconds() - FieldReadyTime);
+	}
+
+	if (bUseInstancedRendering)
+	{
+		RemoveInstancedShape(Handle);
+	}
+	else
+	{
+		TObjectPtr<AShpsBaseShape> DestroyedBaseShape = ShapesArray[Handle];
+		UnregisterShape(DestroyedBaseShape);
+		ReleaseShape(DestroyedBaseShape);
+	}
+
+	if (bInGlobalBalance)
+	{
+		SpawnerSubsystem->QueueGlobalRebalance();
+	}
+	else
+	{
+		QueueRebalance();
 	}
-	return MakeTuple(nullptr, nullptr);
 }
 
-TTuple<TObjectPtr<AShpsBaseShape>, TObjectPtr<AShpsBaseShape>> AShpsShapesSpawner::AdjustColorsAndPrimitiveType()
+FString AShpsShapesSpawner::GetHitRecordingPath(const FString& RecordingName) const
 {
-	bool PrimitiveIsChanged = false;
-	for (const auto& Shape : ShapesArray)
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("HitRecordings"), FString::Printf(TEXT("%s_%s.hits"), *RecordingName, *GetName()));
+}
+
+void AShpsShapesSpawner::InitHitRecording()
+{
+	FParse::Value(FCommandLine::Get(), TEXT("ShapesRecordHits="), HitRecordingName);
+	FParse::Value(FCommandLine::Get(), TEXT("ShapesReplayHits="), HitReplayName);
+	FParse::Value(FCommandLine::Get(), TEXT("ShapesReplaySpeed="), HitReplaySpeed);
+
+	bRecordingHits = !HitRecordingName.IsEmpty();
+
+	if (!HitReplayName.IsEmpty())
 	{
-		if (Shape->GetPrimitiveType().ToString().Equals(*GetPrimitiveTypeLargestQuantity()) && Shape->GetPrimitiveColor().ToString().Equals(*GetColorLargestQuantity()) && !PrimitiveIsChanged)
+		const FString FilePath = GetHitRecordingPath(HitReplayName);
+		if (!HitRecording.LoadFromFile(FilePath))
 		{
-			const TSubclassOf<AShpsBaseShape> ShapeNewType = *PrimitivesMapString.FindKey(*GetPrimitiveTypeLeastQuantity());
-			const FLinearColor ShapeNewColor = *ColorsMapString.FindKey(*GetColorLeastQuantity());
-
-			AShpsBaseShape* NewShape = ChangePrimitiveType(ShapeNewType, Shape);
-			NewShape->SetPrimitiveTypeInfo(NewShape->GetClass(), PrimitivesMap);
-			NewShape->SetPrimitiveSizeInfo();
-												
-			AddColorToShape(NewShape, ShapeNewColor);
-			NewShape->SetPrimitiveColorInfo(ShapeNewColor, ColorsMap);
-
-			TObjectPtr<AShpsBaseShape> ShapeToDelete = Shape;
-			TObjectPtr<AShpsBaseShape> ShapeToAdd = NewShape;
-			Shape->Destroy();
-												
-			PrimitiveIsChanged = true;
-
-			return MakeTuple(ShapeToDelete, ShapeToAdd);
+			UE_LOG(LogShpsSpawner, Warning, TEXT("Couldn't load hit recording %s"), *FilePath);
+			HitReplayName.Empty();
+		}
+		else if (bRecordingHits)
+		{
+			UE_LOG(LogShpsSpawner, Warning, TEXT("Replaying hits, recording is disabled"));
+			bRecordingHits = false;
 		}
 	}
-	return MakeTuple(nullptr, nullptr);
 }
 
-void AShpsShapesSpawner::OnShapeShooted(AActor* BaseShapeActor)
+void AShpsShapesSpawner::StartHitReplay()
 {
-	TObjectPtr<AShpsBaseShape> DestroyedBaseShape = Cast<AShpsBaseShape>(BaseShapeActor);
-	FText DestroyedPrimitiveType = DestroyedBaseShape->GetPrimitiveType();
-	FText DestroyedPrimitiveColor = DestroyedBaseShape->GetPrimitiveColor();
-	
-	ShapesArray.Remove(DestroyedBaseShape);
-	DestroyedBaseShape->Destroy();
-
-	UpdateColorsNumMap(ColorsNumMap);
-	UpdatePrimitivesNumMap(PrimitivesNumMap);
-
-	TArray<FString> PrimitiveTypeOverrepresented = PrimitivesTypeAboveToleranceNumber(PrimitivesNumMap, DestroyedPrimitiveType);
-	TArray<FString> PrimitiveColorOverrepresented = ColorsAboveToleranceNumber(ColorsNumMap, DestroyedPrimitiveColor);
-	
-	TObjectPtr<AShpsBaseShape> ShapeToDelete;
-	TObjectPtr<AShpsBaseShape> ShapeToAdd;
+	if (HitReplayName.IsEmpty())
+	{
+		return;
+	}
 
-	bool ColorIsChanged = false;
-	bool PrimitiveIsChanged = false;
-	
-	//Need just color adjustment, primitives are good
-	if (PrimitiveTypeOverrepresented.IsEmpty() && !PrimitiveColorOverrepresented.IsEmpty())
+	if (HitRecording.GetNumShapes() != BalanceEngine.GetShapeIndex().GetNumHandles() || HitRecording.GetSeed() != FieldRandomStream.GetInitialSeed())
 	{
-		Tie(ShapeToDelete, ShapeToAdd) = AdjustColors();
-		ColorIsChanged = true;
+		UE_LOG(LogShpsSpawner, Error, TEXT("Hit recording %s was made on a field of %d shapes with seed %d, this one has %d shapes with seed %d. Not replaying it, use the seed it was recorded with"),
+			*HitReplayName, HitRecording.GetNumShapes(), HitRecording.GetSeed(), BalanceEngine.GetShapeIndex().GetNumHandles(), FieldRandomStream.GetInitialSeed());
+		HitReplayName.Empty();
+		return;
 	}
 
-	//Need just primitiveType adjumstment, colors are good
-	if (PrimitiveColorOverrepresented.IsEmpty() && !PrimitiveTypeOverrepresented.IsEmpty())
+	bReplayingHits = true;
+	NextReplayHit = 0;
+	SetActorTickEnabled(true);
+	ReplayHits();
+}
+
+void AShpsShapesSpawner::ReplayHits()
+{
+	const TArray<FShpsHitRecord>& Hits = HitRecording.GetHits();
+	const double ReplayTime = (GetWorld()->GetTimeSeconds() - FieldReadyTime) * HitReplaySpeed;
+
+	while (NextReplayHit < Hits.Num() && (HitReplaySpeed <= 0.f || Hits[NextReplayHit].Time <= ReplayTime))
 	{
-		Tie(ShapeToDelete, ShapeToAdd) = AdjustPrimitiveType();
-		PrimitiveIsChanged = true;
+		ShootShape(Hits[NextReplayHit].Handle);
+		++NextReplayHit;
 	}
-	
-	//Need PrimitiveType and Color adjustments
-	if (!PrimitiveColorOverrepresented.IsEmpty() && !PrimitiveTypeOverrepresented.IsEmpty())
+
+	if (NextReplayHit < Hits.Num())
 	{
-		Tie(ShapeToDelete, ShapeToAdd) = AdjustColorsAndPrimitiveType();
-		PrimitiveIsChanged = true;
+		return;
 	}
-	
-	//if (PrimitiveTypeChanged || ColorChanged)
-	if (PrimitiveIsChanged || ColorIsChanged)
+
+	UE_LOG(LogShpsSpawner, Log, TEXT("Replayed %d hits from %s"), Hits.Num(), *HitReplayName);
+	bReplayingHits = false;
+	SetActorTickEnabled(false);
+}
+
+void AShpsShapesSpawner::OnShapeShooted(AActor* BaseShapeActor)
+{
+	TObjectPtr<AShpsBaseShape> DestroyedBaseShape = Cast<AShpsBaseShape>(BaseShapeActor);
+	if (!DestroyedBaseShape || DestroyedBaseShape->GetOwner() != this || !DestroyedBaseShape->IsShapeActive())
 	{
-		ShapesArray.Remove(ShapeToDelete);
-		ShapesArray.Add(ShapeToAdd);
+		return;
 	}
 
-	PrimitiveColorOverrepresented.Empty();
-	PrimitiveTypeOverrepresented.Empty();
+	ShootShape(DestroyedBaseShape->GetShapeHandle());
+}
 
-	UpdateColorsNumMap(ColorsNumMap);
-	UpdatePrimitivesNumMap(PrimitivesNumMap);
+void AShpsShapesSpawner::OnShapeInstanceShooted(UPrimitiveComponent* HitComponent, int32 InstanceIndex)
+{
+	ShootShape(FindInstanceHandle(HitComponent, InstanceIndex));
 }
 
 // Called every frame
 void AShpsShapesSpawner::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
-}
 
+	if (!bFieldReady)
+	{
+		SpawnPendingShapes();
+	}
+	else if (bReplayingHits)
+	{
+		ReplayHits();
+	}
+}
@@ -4,94 +4,393 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "Shapes/Gameplay/Interfaces/ShpsSelectableInterface.h"
+#include "ShpsBalanceEngine.h"
+#include "ShpsPlacementGrid.h"
+#include "ShpsHitRecording.h"
+#include "ShpsPrimitiveCatalog.h"
 #include "ShpsShapesSpawner.generated.h"
 
 class AShpsBaseShape;
 class UBoxComponent;
 class UMaterialInterface;
+class UMaterialInstanceDynamic;
+class UInstancedStaticMeshComponent;
+class UWidgetComponent;
+class UShpsSelectionSubsystem;
+class UShpsSpawnerSubsystem;
+struct FStreamableHandle;
+
+//What happens to a shape that found no free spot in the spawn box
+UENUM(BlueprintType)
+enum class EShpsPlacementFallback : uint8
+{
+	AllowOverlap,
+	//Retry at the minimum scale, skipping the shape if there is still no room
+	ShrinkScale,
+	SkipSpawn
+};
+
+USTRUCT()
+struct FShpsColorMaterials
+{
+	GENERATED_BODY()
+
+	//Indexed by color id
+	UPROPERTY()
+	TArray<TObjectPtr<UMaterialInstanceDynamic>> Instances;
+};
+
+USTRUCT()
+struct FShpsShapePool
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<TObjectPtr<AShpsBaseShape>> Shapes;
+};
+
+struct FShpsPendingSpawn
+{
+	int32 PrimitiveTypeId = INDEX_NONE;
+
+	int32 ColorId = INDEX_NONE;
+
+	FTransform Transform;
+
+	//False when the placement fallback skipped the shape
+	bool bPlaced = false;
+};
+
+USTRUCT()
+struct FShpsInstancedPrimitive
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TObjectPtr<UInstancedStaticMeshComponent> Component;
+
+	//Shape handle per instance index, INDEX_NONE for hidden instances waiting in FreeInstances
+	TArray<int32> InstanceHandles;
+
+	TArray<int32> FreeInstances;
+};
 
 UCLASS()
-class SHAPES_API AShpsShapesSpawner : public AActor
+class SHAPES_API AShpsShapesSpawner : public AActor, public IShpsSelectableInterface
 {
+	DECLARE_MULTICAST_DELEGATE(FOnFieldReadySignature);
+
 	GENERATED_BODY()
 	
 public:	
 	// Sets default values for this actor's properties
 	AShpsShapesSpawner();
 
+	// Called every frame, only while spawning or replaying hits
+	virtual void Tick(float DeltaTime) override;
+
+	bool IsFieldReady() const { return bFieldReady; }
+
+	//Broadcast once the initial spawn queue is drained
+	FOnFieldReadySignature OnFieldReadyDelegate;
+
+	FText GetPrimitiveTypeName(int32 PrimitiveTypeId) const;
+
+	FText GetColorName(int32 ColorId) const;
+
+	//Formatted only when a tooltip asks for it
+	FText GetPrimitiveSizeText(int32 PrimitiveTypeId, const FVector& WorldScale) const;
+
+	UFUNCTION(BlueprintCallable)
+	void SelectShapeInstance(UPrimitiveComponent* Component, int32 InstanceIndex);
+
+	UFUNCTION(BlueprintCallable)
+	void UnselectShapeInstance();
+
+	//Handle based selection used by the selection subsystem, works in both rendering modes
+	void SelectShape(int32 Handle);
+
+	void UnselectShape(int32 Handle);
+
+	//Hits routed here by UShpsSpawnerSubsystem, shapes of other spawners are ignored
+	void OnShapeShooted(AActor* BaseShapeActor);
+
+	void OnShapeInstanceShooted(UPrimitiveComponent* HitComponent, int32 InstanceIndex);
+
+	const FShpsPrimitiveCatalog& GetPrimitiveCatalog() const { return PrimitiveCatalog; }
+
+	const TArray<FLinearColor>& GetColors() const { return Colors; }
+
+	int32 GetToleranceNumber() const { return ToleranceNumber; }
+
+	float GetRebalanceInterval() const { return RebalanceInterval; }
+
+	//Counted by whoever ran the rebalance, the spawner itself or the global balance
+	void CountRebalance();
+
+	//Change planned by the global balance for one of this spawner's shapes
+	void ApplyBalanceChange(int32 Handle, int32 PrimitiveTypeId, int32 ColorId);
+
+	void SelectPrimitive_Implementation() override;
+
+	void UnselectPrimitive_Implementation() override;
+
+	FText GetType_Implementation() override;
+
+	FText GetColor_Implementation() override;
+
+	FText GetSize_Implementation() override;
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	
-	AShpsBaseShape* SpawnShapeInRandomLocAndSize(const TSubclassOf<AShpsBaseShape>& Primitive);
+	void PrecomputePendingSpawns();
+
+	bool GetRandomSpawnTransform(int32 PrimitiveTypeId, const FBox& SpawnBox, FRandomStream& RandomStream, FShpsPlacementGrid& PlacementGrid, FTransform& OutTransform) const;
+
+	bool FindFreeLocation(const FBox& SpawnBox, float Radius, FRandomStream& RandomStream, const FShpsPlacementGrid& PlacementGrid, FVector& OutLocation) const;
 	
-	AShpsBaseShape* ChangePrimitiveType(const TSubclassOf<AShpsBaseShape>& PrimitiveType, AShpsBaseShape* Shape);
+	void ChangePrimitiveType(int32 PrimitiveTypeId, AShpsBaseShape* Shape);
+
+	AShpsBaseShape* AcquireShape(int32 PrimitiveTypeId, const FTransform& SpawnTransform);
+
+	void ReleaseShape(AShpsBaseShape* Shape);
+
+	void PrewarmShapePools();
 	
-	void AddColorsToShapes(TArray<AShpsBaseShape*> Shapes, const TMap<FLinearColor, FText>& Colors);
+	void AddColorToShape(AShpsBaseShape* BaseShape, int32 ColorId);
+
+	UMaterialInstanceDynamic* GetColorMaterial(UMaterialInterface* BaseMaterial, int32 ColorId);
 
-	void AddColorToShape(AShpsBaseShape* BaseShape, const FLinearColor& Color);
+	void LoadPrimitiveTypes();
 
-	void OnRandomNumberGenerated(int Number);
+	void OnPrimitiveTypesLoaded();
+
+	void OnRandomNumberGenerated(int Number, FRandomStream& GameRandomStream);
+
+	void StartSpawning();
 
 	void InitSpawner();
 
-	bool SameNumberOfEachPrimitive(TMap<FString, int>& PrimitivesNum);
+	void SpawnPendingShapes();
 
-	bool SameNumberOfEachColor(TMap<FString, int>& ColorsNum);
+	void SpawnPendingShape(const FShpsPendingSpawn& PendingSpawn);
 
-	TArray<FString> PrimitivesTypeAboveToleranceNumber(TMap<FString, int>& PrimitivesNum, FText& DestroyedPrimitiveType);
+	void InitShapeIndex();
 
-	TArray<FString> ColorsAboveToleranceNumber(TMap<FString, int>& ColorsNum, FText& DestroyedPrimitiveColor);
+	void RegisterShape(AShpsBaseShape* Shape);
 
-	void UpdatePrimitivesNumMap(TMap<FString, int>& PrimitivesNum);
+	void UnregisterShape(AShpsBaseShape* Shape);
 
-	void UpdateColorsNumMap(TMap<FString, int>& ColorsNum);
+	void ChangeShapeCategory(int32 Handle, int32 PrimitiveTypeId, int32 ColorId);
 
-	const FString* GetPrimitiveTypeLargestQuantity() const;
+	//Local balance engine plus the global one while this spawner is part of it
+	int32 AddBalancedShape(int32 PrimitiveTypeId, int32 ColorId);
 
-	const FString* GetPrimitiveTypeLeastQuantity() const;
+	void RemoveBalancedShape(int32 Handle);
 
-	const FString* GetColorLargestQuantity() const;
+	void MoveBalancedShape(int32 Handle, int32 PrimitiveTypeId, int32 ColorId);
 
-	const FString* GetColorLeastQuantity() const;
+	void InitInstancedPrimitives();
 
-	TTuple<TObjectPtr<AShpsBaseShape>, TObjectPtr<AShpsBaseShape>> AdjustColors();
-	
-	TTuple<TObjectPtr<AShpsBaseShape>, TObjectPtr<AShpsBaseShape>> AdjustPrimitiveType();
-	
-	TTuple<TObjectPtr<AShpsBaseShape>, TObjectPtr<AShpsBaseShape>> AdjustColorsAndPrimitiveType();
-	
-	UFUNCTION()
-	void OnShapeShooted(AActor* BaseShapeActor);
+	int32 AcquireInstance(int32 PrimitiveTypeId, const FTransform& InstanceTransform, int32 Handle);
+
+	void ReleaseInstance(int32 PrimitiveTypeId, int32 InstanceIndex);
+
+	void SetInstanceColor(int32 PrimitiveTypeId, int32 InstanceIndex, int32 ColorId);
 
-	TObjectPtr<UMaterialInterface> Material;
+	int32 AddInstancedShape(int32 PrimitiveTypeId, int32 ColorId, const FTransform& InstanceTransform);
 
-	UPROPERTY(EditDefaultsOnly)
+	void RemoveInstancedShape(int32 Handle);
+
+	void ChangeInstancedShapeCategory(int32 Handle, int32 PrimitiveTypeId, int32 ColorId);
+
+	int32 FindInstanceHandle(const UPrimitiveComponent* Component, int32 InstanceIndex) const;
+
+	//ShapeTransform is the world transform of the mesh, the actor's for shapes and the world space one for instances
+	FBoxSphereBounds GetShapeBounds(int32 PrimitiveTypeId, const FTransform& ShapeTransform) const;
+
+	void QueueRebalance();
+
+	void RebalanceAfterShapeRemoved();
+
+	void ShootShape(int32 Handle);
+
+	void UpdateRebalanceRateStat();
+
+	FString GetHitRecordingPath(const FString& RecordingName) const;
+
+	void InitHitRecording();
+
+	void StartHitReplay();
+
+	void ReplayHits();
+
+	//Largest allowed difference between the most and least numerous primitive type, and between colors
+	UPROPERTY(EditDefaultsOnly, meta = (ClampMin = "1"))
 	int ToleranceNumber = 1;
 
+	//Seconds between rebalances while shapes are being shot, 0 rebalances once on the frame after the hits
+	UPROPERTY(EditAnywhere, Category = "Balance", meta = (ClampMin = "0", Units = "s"))
+	float RebalanceInterval = 0.f;
+
+	//Balance together with every other global spawner with the same primitive types and colors, the first one's ToleranceNumber and RebalanceInterval apply
+	UPROPERTY(EditAnywhere, Category = "Balance")
+	bool bUseGlobalBalance = false;
+
+	bool bInGlobalBalance = false;
+
+	//Routes hits to this spawner and owns the global balance
+	UPROPERTY()
+	TObjectPtr<UShpsSpawnerSubsystem> SpawnerSubsystem;
+
+	bool bRebalanceQueued = false;
+
+	//A hit landed before the field was ready, the rebalance it asked for runs once it is
+	bool bRebalanceDeferred = false;
+
+	FTimerHandle RebalanceTimerHandle;
+
 	UPROPERTY()
 	int RandomNumber = 1;
+
+	//Render every primitive type through one instanced static mesh component instead of one actor per shape
+	UPROPERTY(EditAnywhere, Category = "Instancing")
+	bool bUseInstancedRendering = false;
+
+	//Material for instanced primitives, it should read the color from PerInstanceCustomData 0-2. Required, without it the spawner falls back to shape actors
+	UPROPERTY(EditAnywhere, Category = "Instancing", meta = (EditCondition = "bUseInstancedRendering"))
+	TObjectPtr<UMaterialInterface> InstancedMaterial;
+
+	//Deactivated shapes spawned ahead per primitive type, so retypes don't spawn actors during a hit
+	UPROPERTY(EditAnywhere, Category = "Pool")
+	int PoolPrewarmNumber = 2;
+
+	//Initial spawn is spread over frames, each frame stops at whichever limit is hit first
+	UPROPERTY(EditAnywhere, Category = "Spawning", meta = (ClampMin = "1"))
+	int MaxSpawnsPerFrame = 32;
+
+	UPROPERTY(EditAnywhere, Category = "Spawning", meta = (ClampMin = "0.1", Units = "ms"))
+	float SpawnTimeBudgetMs = 2.f;
+
+	UPROPERTY(EditAnywhere, Category = "Spawning", meta = (ClampMin = "0.01"))
+	float MinSpawnScale = 0.5f;
+
+	UPROPERTY(EditAnywhere, Category = "Spawning", meta = (ClampMin = "0.01"))
+	float MaxSpawnScale = 2.5f;
+
+	//Keep the scaled bounds of spawned shapes apart
+	UPROPERTY(EditAnywhere, Category = "Placement")
+	bool bPreventOverlaps = true;
+
+	//Random locations tried before the fallback kicks in
+	UPROPERTY(EditAnywhere, Category = "Placement", meta = (ClampMin = "1", EditCondition = "bPreventOverlaps"))
+	int MaxPlacementAttempts = 8;
+
+	UPROPERTY(EditAnywhere, Category = "Placement", meta = (EditCondition = "bPreventOverlaps"))
+	EShpsPlacementFallback PlacementFallback = EShpsPlacementFallback::ShrinkScale;
+
+	//Spawn transforms are computed on worker threads in chunks of at least this many shapes
+	UPROPERTY(EditAnywhere, Category = "Spawning", meta = (ClampMin = "1"))
+	int MinSpawnsPerChunk = 256;
+
+	TArray<FShpsPendingSpawn> PendingSpawns;
+
+	int32 NextPendingSpawn = 0;
+
+	bool bFieldReady = false;
 	
 	UPROPERTY(EditAnywhere, Category = "Arrays")
 	TMap<FLinearColor, FText> ColorsMap;
 
+	//Loaded asynchronously at BeginPlay, the field is spawned once they are in
+	UPROPERTY(EditAnywhere, Category = "Arrays")
+	TMap<TSoftClassPtr<AShpsBaseShape>, FText> PrimitivesMap;
+
+	TSharedPtr<FStreamableHandle> PrimitiveTypesHandle;
+
+	bool bPrimitiveTypesLoaded = false;
+
+	bool bRandomNumberGenerated = false;
+
+	//Resolved from ColorsMap and PrimitivesMap once the primitive classes are loaded, the index is the category id carried by shapes
 	UPROPERTY()
-	TMap<FLinearColor, FString> ColorsMapString;
+	TArray<FLinearColor> Colors;
 
-	UPROPERTY(EditAnywhere, Category = "Arrays")
-	TMap<TSubclassOf<AShpsBaseShape>, FText> PrimitivesMap;
+	UPROPERTY()
+	TArray<FText> ColorNames;
 
 	UPROPERTY()
-	TMap<TSubclassOf<AShpsBaseShape>, FString> PrimitivesMapString;
+	FShpsPrimitiveCatalog PrimitiveCatalog;
 	
+	//Indexed by shape handle, slots of destroyed shapes stay null until the handle is reused
 	UPROPERTY(EditDefaultsOnly,Category = "Arrays")
 	TArray<TObjectPtr<AShpsBaseShape>> ShapesArray;
 
+	//Live shapes per category and the rules deciding which of them changes after a hit
+	FShpsBalanceEngine BalanceEngine;
+
+	//Reused between rebalances
+	TArray<FShpsBalanceChange> BalanceChanges;
+
+	//Deactivated shapes per primitive type id
+	UPROPERTY()
+	TArray<FShpsShapePool> ShapePools;
+
+	//Color material instances shared by all shapes with the same base material
 	UPROPERTY()
-	TMap<FString, int> PrimitivesNumMap;
+	TMap<TObjectPtr<UMaterialInterface>, FShpsColorMaterials> ColorMaterialsCache;
+
+	//Instanced rendering mode, one entry per primitive type id
+	UPROPERTY()
+	TArray<FShpsInstancedPrimitive> InstancedPrimitives;
+
+	//Instance index of each shape handle within its primitive type's component
+	TArray<int32> ShapeInstances;
+
+	int32 SelectedHandle = INDEX_NONE;
 
+	//Keeps the live shapes in its octree for crosshair selection
 	UPROPERTY()
-	TMap<FString, int> ColorsNumMap;
+	TObjectPtr<UShpsSelectionSubsystem> SelectionSubsystem;
+
+	//Seeded from the game mode's stream, drives everything random about this spawner's field
+	FRandomStream FieldRandomStream;
+
+	//Hits are saved to Saved/HitRecordings/<name>_<spawner>.hits, -ShapesRecordHits=<name> overrides it. Shapes can't be shot until the field is ready
+	UPROPERTY(EditAnywhere, Category = "Hit Replay")
+	FString HitRecordingName;
+
+	//Replays a recording once the field is ready, the field has to be spawned with the seed it was recorded with. -ShapesReplayHits=<name> overrides it
+	UPROPERTY(EditAnywhere, Category = "Hit Replay")
+	FString HitReplayName;
+
+	//Multiplier on the recorded timing, 0 replays every hit in one frame. -ShapesReplaySpeed=<speed> overrides it
+	UPROPERTY(EditAnywhere, Category = "Hit Replay", meta = (ClampMin = "0"))
+	float HitReplaySpeed = 1.f;
+
+	FShpsHitRecording HitRecording;
+
+	bool bRecordingHits = false;
+
+	bool bReplayingHits = false;
+
+	int32 NextReplayHit = 0;
+
+	double FieldReadyTime = 0.0;
+
+	//Feeds the rebalances per second stat
+	static constexpr float RebalanceRateSampleInterval = 1.f;
+
+	int32 RebalancesSinceLastSample = 0;
+
+	float ReportedRebalanceRate = 0.f;
+
+	FTimerHandle RebalanceRateTimerHandle;
 	
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	TObjectPtr<UStaticMeshComponent> StaticMeshComponent;
@@ -99,8 +398,7 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	TObjectPtr<UBoxComponent> BoxComponent;
 
-public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
+	//Tooltip of the selected instance in instanced rendering mode
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	TObjectPtr<UWidgetComponent> TooltipWidgetComponent;
 };
\ No newline at end of file
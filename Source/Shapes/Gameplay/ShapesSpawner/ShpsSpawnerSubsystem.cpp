@@ -0,0 +1,243 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ShpsSpawnerSubsystem.h"
+#include "Shapes/Shapes.h"
+#include "ShpsShapesSpawner.h"
+#include "Shapes/Core/Character/ShpsCharacter.h"
+#include "Engine/World.h"
+#include "TimerManager.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogShpsSpawnerSubsystem, Log, All);
+
+DECLARE_CYCLE_STAT(TEXT("Global rebalance"), STAT_ShapesGlobalRebalance, STATGROUP_Shapes);
+
+bool UShpsSpawnerSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UShpsSpawnerSubsystem::Deinitialize()
+{
+	Spawners.Empty();
+	GlobalSpawners.Empty();
+	GlobalShapes.Empty();
+	GlobalHandles.Empty();
+
+	Super::Deinitialize();
+}
+
+void UShpsSpawnerSubsystem::RegisterSpawner(AShpsShapesSpawner* Spawner)
+{
+	Spawners.AddUnique(Spawner);
+}
+
+void UShpsSpawnerSubsystem::UnregisterSpawner(AShpsShapesSpawner* Spawner)
+{
+	LeaveGlobalBalance(Spawner);
+	Spawners.Remove(Spawner);
+}
+
+void UShpsSpawnerSubsystem::RegisterCharacter(AShpsCharacter* Character)
+{
+	//One binding for every spawner, each hit is then routed to its owner only
+	Character->OnShapeShootedDelegate.AddUniqueDynamic(this, &UShpsSpawnerSubsystem::OnShapeShooted);
+	Character->OnShapeInstanceShootedDelegate.AddUniqueDynamic(this, &UShpsSpawnerSubsystem::OnShapeInstanceShooted);
+}
+
+void UShpsSpawnerSubsystem::UnregisterCharacter(AShpsCharacter* Character)
+{
+	Character->OnShapeShootedDelegate.RemoveDynamic(this, &UShpsSpawnerSubsystem::OnShapeShooted);
+	Character->OnShapeInstanceShootedDelegate.RemoveDynamic(this, &UShpsSpawnerSubsystem::OnShapeInstanceShooted);
+}
+
+void UShpsSpawnerSubsystem::OnShapeShooted(AActor* BaseShapeActor)
+{
+	TObjectPtr<AShpsShapesSpawner> Spawner = BaseShapeActor ? Cast<AShpsShapesSpawner>(BaseShapeActor->GetOwner()) : nullptr;
+	if (Spawner)
+	{
+		Spawner->OnShapeShooted(BaseShapeActor);
+	}
+}
+
+void UShpsSpawnerSubsystem::OnShapeInstanceShooted(UPrimitiveComponent* HitComponent, int32 InstanceIndex)
+{
+	//Instanced components are created by the spawner itself
+	TObjectPtr<AShpsShapesSpawner> Spawner = HitComponent ? Cast<AShpsShapesSpawner>(HitComponent->GetOwner()) : nullptr;
+	if (Spawner)
+	{
+		Spawner->OnShapeInstanceShooted(HitComponent, InstanceIndex);
+	}
+}
+
+bool UShpsSpawnerSubsystem::JoinGlobalBalance(AShpsShapesSpawner* Spawner)
+{
+	if (GlobalSpawners.Contains(Spawner))
+	{
+		return true;
+	}
+
+	const FShpsPrimitiveCatalog& PrimitiveCatalog = Spawner->GetPrimitiveCatalog();
+	if (GlobalSpawners.Num() == 0)
+	{
+		GlobalBalanceEngine.Init(PrimitiveCatalog.Num(), Spawner->GetColors().Num(), Spawner->GetToleranceNumber());
+		GlobalShapes.Reset();
+	}
+	else
+	{
+		//Category ids have to mean the same on every spawner balanced together
+		const AShpsShapesSpawner* FirstSpawner = GlobalSpawners[0];
+		bool bSameCategories = FirstSpawner->GetColors() == Spawner->GetColors() && FirstSpawner->GetPrimitiveCatalog().Num() == PrimitiveCatalog.Num();
+		for (int32 PrimitiveTypeId = 0; bSameCategories && PrimitiveTypeId < PrimitiveCatalog.Num(); ++PrimitiveTypeId)
+		{
+			bSameCategories = FirstSpawner->GetPrimitiveCatalog().Get(PrimitiveTypeId).ShapeClass == PrimitiveCatalog.Get(PrimitiveTypeId).ShapeClass;
+		}
+
+		if (!bSameCategories)
+		{
+			UE_LOG(LogShpsSpawnerSubsystem, Warning, TEXT("%s has other primitive types or colors than %s, it is balanced on its own"), *Spawner->GetName(), *FirstSpawner->GetName());
+			return false;
+		}
+	}
+
+	GlobalSpawners.Add(Spawner);
+	GlobalHandles.Add(Spawner);
+	return true;
+}
+
+void UShpsSpawnerSubsystem::LeaveGlobalBalance(AShpsShapesSpawner* Spawner)
+{
+	TArray<int32> SpawnerGlobalHandles;
+	if (!GlobalHandles.RemoveAndCopyValue(Spawner, SpawnerGlobalHandles))
+	{
+		return;
+	}
+
+	for (int32 GlobalHandle : SpawnerGlobalHandles)
+	{
+		if (GlobalBalanceEngine.IsValidHandle(GlobalHandle))
+		{
+			GlobalBalanceEngine.RemoveShape(GlobalHandle);
+			GlobalShapes[GlobalHandle] = FShpsGlobalShape();
+		}
+	}
+
+	GlobalSpawners.Remove(Spawner);
+}
+
+void UShpsSpawnerSubsystem::AddGlobalShape(AShpsShapesSpawner* Spawner, int32 Handle, int32 PrimitiveTypeId, int32 ColorId)
+{
+	TArray<int32>* SpawnerGlobalHandles = GlobalHandles.Find(Spawner);
+	if (!SpawnerGlobalHandles)
+	{
+		return;
+	}
+
+	const int32 GlobalHandle = GlobalBalanceEngine.AddShape(PrimitiveTypeId, ColorId);
+	if (!GlobalShapes.IsValidIndex(GlobalHandle))
+	{
+		GlobalShapes.SetNum(GlobalHandle + 1);
+	}
+	GlobalShapes[GlobalHandle].Spawner = Spawner;
+	GlobalShapes[GlobalHandle].Handle = Handle;
+
+	while (!SpawnerGlobalHandles->IsValidIndex(Handle))
+	{
+		SpawnerGlobalHandles->Add(INDEX_NONE);
+	}
+	(*SpawnerGlobalHandles)[Handle] = GlobalHandle;
+}
+
+void UShpsSpawnerSubsystem::RemoveGlobalShape(AShpsShapesSpawner* Spawner, int32 Handle)
+{
+	TArray<int32>* SpawnerGlobalHandles = GlobalHandles.Find(Spawner);
+	if (!SpawnerGlobalHandles || !SpawnerGlobalHandles->IsValidIndex(Handle))
+	{
+		return;
+	}
+
+	const int32 GlobalHandle = (*SpawnerGlobalHandles)[Handle];
+	if (GlobalBalanceEngine.IsValidHandle(GlobalHandle))
+	{
+		GlobalBalanceEngine.RemoveShape(GlobalHandle);
+		GlobalShapes[GlobalHandle] = FShpsGlobalShape();
+	}
+	(*SpawnerGlobalHandles)[Handle] = INDEX_NONE;
+}
+
+void UShpsSpawnerSubsystem::MoveGlobalShape(AShpsShapesSpawner* Spawner, int32 Handle, int32 PrimitiveTypeId, int32 ColorId)
+{
+	const TArray<int32>* SpawnerGlobalHandles = GlobalHandles.Find(Spawner);
+	if (!SpawnerGlobalHandles || !SpawnerGlobalHandles->IsValidIndex(Handle))
+	{
+		return;
+	}
+
+	const int32 GlobalHandle = (*SpawnerGlobalHandles)[Handle];
+	if (GlobalBalanceEngine.IsValidHandle(GlobalHandle))
+	{
+		GlobalBalanceEngine.MoveShape(GlobalHandle, PrimitiveTypeId, ColorId);
+	}
+}
+
+void UShpsSpawnerSubsystem::QueueGlobalRebalance()
+{
+	if (bGlobalRebalanceQueued)
+	{
+		return;
+	}
+	bGlobalRebalanceQueued = true;
+
+	const float RebalanceInterval = GlobalSpawners.Num() > 0 ? GlobalSpawners[0]->GetRebalanceInterval() : 0.f;
+	if (RebalanceInterval > 0.f)
+	{
+		GetWorld()->GetTimerManager().SetTimer(GlobalRebalanceTimerHandle, this, &UShpsSpawnerSubsystem::GlobalRebalance, RebalanceInterval, false);
+	}
+	else
+	{
+		GlobalRebalanceTimerHandle = GetWorld()->GetTimerManager().SetTimerForNextTick(this, &UShpsSpawnerSubsystem::GlobalRebalance);
+	}
+}
+
+void UShpsSpawnerSubsystem::OnSpawnerFieldReady(AShpsShapesSpawner* Spawner)
+{
+	if (bGlobalRebalanceDeferred && GlobalSpawners.Contains(Spawner))
+	{
+		bGlobalRebalanceDeferred = false;
+		QueueGlobalRebalance();
+	}
+}
+
+void UShpsSpawnerSubsystem::GlobalRebalance()
+{
+	bGlobalRebalanceQueued = false;
+
+	//Same as a single spawner, counts only mean something once every field is spawned
+	for (const AShpsShapesSpawner* Spawner : GlobalSpawners)
+	{
+		if (!Spawner->IsFieldReady())
+		{
+			bGlobalRebalanceDeferred = true;
+			return;
+		}
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_ShapesGlobalRebalance);
+
+	GlobalBalanceEngine.PlanRebalance(GlobalBalanceChanges);
+	if (GlobalBalanceChanges.Num() == 0)
+	{
+		return;
+	}
+
+	//Each spawner applies its share and reports the move back through MoveGlobalShape
+	for (const FShpsBalanceChange& Change : GlobalBalanceChanges)
+	{
+		const FShpsGlobalShape& GlobalShape = GlobalShapes[Change.Handle];
+		GlobalShape.Spawner->ApplyBalanceChange(GlobalShape.Handle, Change.PrimitiveTypeId, Change.ColorId);
+	}
+	GlobalBalanceChanges.Reset();
+
+	//Credited once to the first spawner, the rate stat sums every spawner's share
+	GlobalSpawners[0]->CountRebalance();
+}
@@ -0,0 +1,95 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Engine/EngineTypes.h"
+#include "ShpsBalanceEngine.h"
+#include "ShpsSpawnerSubsystem.generated.h"
+
+class AShpsShapesSpawner;
+class AShpsCharacter;
+
+//Spawner and its own handle behind a global balance handle
+struct FShpsGlobalShape
+{
+	AShpsShapesSpawner* Spawner = nullptr;
+
+	int32 Handle = INDEX_NONE;
+};
+
+/**
+ * Listens to each character's hits once for all spawners and hands each hit to the spawner owning the shape.
+ * Characters register themselves when they begin play, so a respawned or repossessed pawn is picked up again.
+ * Spawners with bUseGlobalBalance also keep their shapes in one balance engine here, so the field is balanced
+ * across all of them instead of per spawner.
+ */
+UCLASS()
+class SHAPES_API UShpsSpawnerSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	void RegisterSpawner(AShpsShapesSpawner* Spawner);
+
+	void UnregisterSpawner(AShpsShapesSpawner* Spawner);
+
+	void RegisterCharacter(AShpsCharacter* Character);
+
+	void UnregisterCharacter(AShpsCharacter* Character);
+
+	//False when the spawner's primitive types or colors differ from the spawners already balanced globally
+	bool JoinGlobalBalance(AShpsShapesSpawner* Spawner);
+
+	void AddGlobalShape(AShpsShapesSpawner* Spawner, int32 Handle, int32 PrimitiveTypeId, int32 ColorId);
+
+	void RemoveGlobalShape(AShpsShapesSpawner* Spawner, int32 Handle);
+
+	void MoveGlobalShape(AShpsShapesSpawner* Spawner, int32 Handle, int32 PrimitiveTypeId, int32 ColorId);
+
+	//Hits of every global spawner until the first spawner's RebalanceInterval is up share one rebalance
+	void QueueGlobalRebalance();
+
+	//Runs the rebalance held back while the spawner was still spawning
+	void OnSpawnerFieldReady(AShpsShapesSpawner* Spawner);
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+	virtual void Deinitialize() override;
+
+	void LeaveGlobalBalance(AShpsShapesSpawner* Spawner);
+
+	void GlobalRebalance();
+
+	UFUNCTION()
+	void OnShapeShooted(AActor* BaseShapeActor);
+
+	UFUNCTION()
+	void OnShapeInstanceShooted(UPrimitiveComponent* HitComponent, int32 InstanceIndex);
+
+	UPROPERTY()
+	TArray<TObjectPtr<AShpsShapesSpawner>> Spawners;
+
+	//Spawners balanced together, the first one sets the categories, the tolerance and the rebalance interval
+	UPROPERTY()
+	TArray<TObjectPtr<AShpsShapesSpawner>> GlobalSpawners;
+
+	FShpsBalanceEngine GlobalBalanceEngine;
+
+	//Indexed by global handle
+	TArray<FShpsGlobalShape> GlobalShapes;
+
+	//Global handle of each spawner handle
+	TMap<AShpsShapesSpawner*, TArray<int32>> GlobalHandles;
+
+	//Reused between rebalances
+	TArray<FShpsBalanceChange> GlobalBalanceChanges;
+
+	bool bGlobalRebalanceQueued = false;
+
+	FTimerHandle GlobalRebalanceTimerHandle;
+
+	bool bGlobalRebalanceDeferred = false;
+};
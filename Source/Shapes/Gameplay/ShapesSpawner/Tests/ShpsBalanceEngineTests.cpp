@@ -0,0 +1,131 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Misc/AutomationTest.h"
+#include "Shapes/Gameplay/ShapesSpawner/ShpsBalanceEngine.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FShpsBalanceEngineToleranceTest, "Shapes.BalanceEngine.Tolerance", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FShpsBalanceEngineToleranceTest::RunTest(const FString& Parameters)
+{
+	//Three primitive types and two colors, counts 2, 1, 1 per type and 3, 1 per color
+	FShpsBalanceEngine BalanceEngine;
+	BalanceEngine.Init(3, 2, 1);
+	BalanceEngine.AddShape(0, 0);
+	const int32 Handle = BalanceEngine.AddShape(0, 0);
+	BalanceEngine.AddShape(1, 0);
+	BalanceEngine.AddShape(2, 1);
+
+	TestFalse(TEXT("Types differing by the tolerance are balanced"), BalanceEngine.PrimitivesTypeAboveToleranceNumber());
+	TestFalse(TEXT("Types differing by the tolerance aren't even"), BalanceEngine.SameNumberOfEachPrimitive());
+	TestTrue(TEXT("Colors differing by more than the tolerance are out"), BalanceEngine.ColorsAboveToleranceNumber());
+
+	TArray<FShpsBalanceChange> Changes;
+	BalanceEngine.PlanRebalance(Changes);
+	if (TestEqual(TEXT("One change fixes the colors"), Changes.Num(), 1))
+	{
+		TestEqual(TEXT("Change moves to the least color"), Changes[0].ColorId, 1);
+		TestEqual(TEXT("Change keeps the primitive type within tolerance"), BalanceEngine.GetPrimitiveTypeId(Changes[0].Handle), Changes[0].PrimitiveTypeId);
+		BalanceEngine.MoveShape(Changes[0].Handle, Changes[0].PrimitiveTypeId, Changes[0].ColorId);
+	}
+	TestFalse(TEXT("Colors balanced after the change"), BalanceEngine.ColorsAboveToleranceNumber());
+	TestTrue(TEXT("Colors even after the change"), BalanceEngine.SameNumberOfEachColor());
+
+	//One more shape of the largest type puts the types out, 3 against 1
+	BalanceEngine.AddShape(0, 1);
+	TestTrue(TEXT("Types differing by more than the tolerance are out"), BalanceEngine.PrimitivesTypeAboveToleranceNumber());
+
+	//Removing one brings them back
+	BalanceEngine.RemoveShape(Handle);
+	TestFalse(TEXT("Types balanced after a removal"), BalanceEngine.PrimitivesTypeAboveToleranceNumber());
+	BalanceEngine.PlanRebalance(Changes);
+	TestEqual(TEXT("Nothing planned within tolerance"), Changes.Num(), 0);
+
+	//The same 3 against 1 is within a tolerance of 2
+	FShpsBalanceEngine LooseBalanceEngine;
+	LooseBalanceEngine.Init(2, 1, 2);
+	LooseBalanceEngine.AddShape(0, 0);
+	LooseBalanceEngine.AddShape(0, 0);
+	LooseBalanceEngine.AddShape(0, 0);
+	LooseBalanceEngine.AddShape(1, 0);
+	TestFalse(TEXT("Types within a tolerance of 2"), LooseBalanceEngine.PrimitivesTypeAboveToleranceNumber());
+	LooseBalanceEngine.PlanRebalance(Changes);
+	TestEqual(TEXT("Nothing planned within a tolerance of 2"), Changes.Num(), 0);
+
+	LooseBalanceEngine.AddShape(0, 0);
+	TestTrue(TEXT("Types out of a tolerance of 2"), LooseBalanceEngine.PrimitivesTypeAboveToleranceNumber());
+	LooseBalanceEngine.PlanRebalance(Changes);
+	TestEqual(TEXT("One change brings 4 against 1 within a tolerance of 2"), Changes.Num(), 1);
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FShpsBalanceEngineRandomFieldsTest, "Shapes.BalanceEngine.RandomFieldsEndWithinTolerance", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FShpsBalanceEngineRandomFieldsTest::RunTest(const FString& Parameters)
+{
+	FRandomStream RandomStream(1234);
+
+	for (int32 Field = 0; Field < 500; ++Field)
+	{
+		const int32 NumPrimitiveTypes = RandomStream.RandRange(1, 6);
+		const int32 NumColors = RandomStream.RandRange(1, 6);
+		const int32 ToleranceNumber = RandomStream.RandRange(1, 3);
+
+		FShpsBalanceEngine BalanceEngine;
+		BalanceEngine.Init(NumPrimitiveTypes, NumColors, ToleranceNumber);
+
+		//Skew the field towards the first categories so it starts well out of tolerance
+		TArray<int32> Handles;
+		const int32 NumShapes = RandomStream.RandRange(0, 300);
+		for (int32 Shape = 0; Shape < NumShapes; ++Shape)
+		{
+			const int32 PrimitiveTypeId = RandomStream.RandRange(0, RandomStream.RandRange(0, NumPrimitiveTypes - 1));
+			const int32 ColorId = RandomStream.RandRange(0, RandomStream.RandRange(0, NumColors - 1));
+			Handles.Add(BalanceEngine.AddShape(PrimitiveTypeId, ColorId));
+		}
+
+		//Shoot some of them so handles get reused
+		const int32 NumRemoved = RandomStream.RandRange(0, NumShapes / 2);
+		for (int32 Removed = 0; Removed < NumRemoved; ++Removed)
+		{
+			const int32 Index = RandomStream.RandRange(0, Handles.Num() - 1);
+			BalanceEngine.RemoveShape(Handles[Index]);
+			Handles.RemoveAtSwap(Index);
+		}
+		for (int32 Added = RandomStream.RandRange(0, 20); Added > 0; --Added)
+		{
+			Handles.Add(BalanceEngine.AddShape(RandomStream.RandRange(0, NumPrimitiveTypes - 1), 0));
+		}
+
+		TArray<FShpsBalanceChange> Changes;
+		BalanceEngine.PlanRebalance(Changes);
+
+		TSet<int32> ChangedHandles;
+		for (const FShpsBalanceChange& Change : Changes)
+		{
+			bool bAlreadyChanged = false;
+			ChangedHandles.Add(Change.Handle, &bAlreadyChanged);
+			if (!TestFalse(FString::Printf(TEXT("Field %d changes handle %d more than once"), Field, Change.Handle), bAlreadyChanged)
+				|| !TestTrue(FString::Printf(TEXT("Field %d changes live handle %d"), Field, Change.Handle), BalanceEngine.IsValidHandle(Change.Handle)))
+			{
+				return false;
+			}
+			BalanceEngine.MoveShape(Change.Handle, Change.PrimitiveTypeId, Change.ColorId);
+		}
+
+		const FShpsCategoryCounter& PrimitivesNum = BalanceEngine.GetPrimitivesNum();
+		const FShpsCategoryCounter& ColorsNum = BalanceEngine.GetColorsNum();
+		if (!TestTrue(FString::Printf(TEXT("Field %d ends with primitive types within tolerance"), Field), PrimitivesNum.GetLargestCount() - PrimitivesNum.GetLeastCount() <= ToleranceNumber)
+			|| !TestTrue(FString::Printf(TEXT("Field %d ends with colors within tolerance"), Field), ColorsNum.GetLargestCount() - ColorsNum.GetLeastCount() <= ToleranceNumber))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#endif
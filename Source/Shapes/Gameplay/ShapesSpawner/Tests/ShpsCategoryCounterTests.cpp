@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Misc/AutomationTest.h"
+#include "Shapes/Gameplay/ShapesSpawner/ShpsCategoryCounter.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FShpsCategoryCounterTest, "Shapes.CategoryCounter.LargestAndLeast", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FShpsCategoryCounterTest::RunTest(const FString& Parameters)
+{
+	FShpsCategoryCounter Counter;
+	Counter.Init(3);
+	TestEqual(TEXT("Empty counter largest count"), Counter.GetLargestCount(), 0);
+	TestEqual(TEXT("Empty counter least count"), Counter.GetLeastCount(), 0);
+
+	//Add: 0 -> 2, 1 -> 1, 2 -> 0
+	Counter.Increment(0);
+	Counter.Increment(0);
+	Counter.Increment(1);
+	TestEqual(TEXT("Largest after add"), Counter.GetLargest(), 0);
+	TestEqual(TEXT("Largest count after add"), Counter.GetLargestCount(), 2);
+	TestEqual(TEXT("Least after add"), Counter.GetLeast(), 2);
+	TestEqual(TEXT("Least count after add"), Counter.GetLeastCount(), 0);
+
+	//Remove: 0 -> 0, 1 -> 1, 2 -> 0
+	Counter.Decrement(0);
+	Counter.Decrement(0);
+	TestEqual(TEXT("Largest after remove"), Counter.GetLargest(), 1);
+	TestEqual(TEXT("Largest count after remove"), Counter.GetLargestCount(), 1);
+	TestEqual(TEXT("Least count after remove"), Counter.GetLeastCount(), 0);
+	TestTrue(TEXT("Least after remove"), Counter.GetLeast() == 0 || Counter.GetLeast() == 2);
+
+	//Move from 1 to 2: 0 -> 0, 1 -> 0, 2 -> 1
+	Counter.Decrement(1);
+	Counter.Increment(2);
+	TestEqual(TEXT("Largest after move"), Counter.GetLargest(), 2);
+	TestEqual(TEXT("Largest count after move"), Counter.GetLargestCount(), 1);
+	TestEqual(TEXT("Least count after move"), Counter.GetLeastCount(), 0);
+	TestEqual(TEXT("Count of the moved from category"), Counter.GetCount(1), 0);
+
+	//Random adds, removes and moves checked against a plain scan
+	FRandomStream RandomStream(42);
+	TArray<int32> Counts;
+	Counts.Init(0, 5);
+	Counter.Init(5);
+	for (int32 Step = 0; Step < 2000; ++Step)
+	{
+		const int32 Category = RandomStream.RandRange(0, 4);
+		const int32 Action = RandomStream.RandRange(0, 2);
+		if (Action == 0 || Counts[Category] == 0)
+		{
+			Counter.Increment(Category);
+			++Counts[Category];
+		}
+		else if (Action == 1)
+		{
+			Counter.Decrement(Category);
+			--Counts[Category];
+		}
+		else
+		{
+			const int32 ToCategory = RandomStream.RandRange(0, 4);
+			Counter.Decrement(Category);
+			--Counts[Category];
+			Counter.Increment(ToCategory);
+			++Counts[ToCategory];
+		}
+
+		int32 LargestCount = Counts[0];
+		int32 LeastCount = Counts[0];
+		for (const int32 Count : Counts)
+		{
+			LargestCount = FMath::Max(LargestCount, Count);
+			LeastCount = FMath::Min(LeastCount, Count);
+		}
+
+		if (!TestEqual(FString::Printf(TEXT("Largest count at step %d"), Step), Counter.GetLargestCount(), LargestCount)
+			|| !TestEqual(FString::Printf(TEXT("Least count at step %d"), Step), Counter.GetLeastCount(), LeastCount)
+			|| !TestEqual(FString::Printf(TEXT("Largest at step %d"), Step), Counts[Counter.GetLargest()], LargestCount)
+			|| !TestEqual(FString::Printf(TEXT("Least at step %d"), Step), Counts[Counter.GetLeast()], LeastCount))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,95 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Misc/AutomationTest.h"
+#include "Shapes/Gameplay/ShapesSpawner/ShpsShapeIndex.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FShpsShapeIndexHandlesTest, "Shapes.ShapeIndex.HandlesSurviveSwapRemove", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FShpsShapeIndexHandlesTest::RunTest(const FString& Parameters)
+{
+	FShpsShapeIndex ShapeIndex;
+	ShapeIndex.Init(2, 2);
+
+	//Three shapes in one cell, removing the first swaps the last one into its slot
+	const int32 First = ShapeIndex.Add(1, 1);
+	const int32 Second = ShapeIndex.Add(1, 1);
+	const int32 Third = ShapeIndex.Add(1, 1);
+	const int32 Other = ShapeIndex.Add(0, 1);
+
+	ShapeIndex.Remove(First);
+	TestFalse(TEXT("Removed handle is invalid"), ShapeIndex.IsValidHandle(First));
+	TestTrue(TEXT("Second handle still valid"), ShapeIndex.IsValidHandle(Second));
+	TestTrue(TEXT("Swapped handle still valid"), ShapeIndex.IsValidHandle(Third));
+	TestEqual(TEXT("Swapped handle keeps its primitive type"), ShapeIndex.GetPrimitiveTypeId(Third), 1);
+	TestEqual(TEXT("Swapped handle keeps its color"), ShapeIndex.GetColorId(Third), 1);
+	TestEqual(TEXT("Cell shrinks"), ShapeIndex.GetCellNum(1, 1), 2);
+
+	//Moving out of the cell swaps again, the moved shape keeps its handle
+	ShapeIndex.Move(Second, 0, 0);
+	TestTrue(TEXT("Moved handle still valid"), ShapeIndex.IsValidHandle(Second));
+	TestEqual(TEXT("Moved handle primitive type"), ShapeIndex.GetPrimitiveTypeId(Second), 0);
+	TestEqual(TEXT("Moved handle color"), ShapeIndex.GetColorId(Second), 0);
+	TestEqual(TEXT("One shape left in the cell"), ShapeIndex.GetCellNum(1, 1), 1);
+	TestEqual(TEXT("Shape left in the cell"), ShapeIndex.GetCellHandle(1, 1, 0), Third);
+	TestEqual(TEXT("Untouched shape"), ShapeIndex.GetCellHandle(0, 1, 0), Other);
+
+	//A freed handle is reused without disturbing the others
+	const int32 Reused = ShapeIndex.Add(1, 0);
+	TestEqual(TEXT("Freed handle is reused"), Reused, First);
+	TestEqual(TEXT("Number of shapes"), ShapeIndex.Num(), 4);
+
+	//Random adds, removes and moves checked against the category each handle was given
+	FRandomStream RandomStream(7);
+	TMap<int32, TPair<int32, int32>> Expected;
+	ShapeIndex.Init(3, 4);
+	for (int32 Step = 0; Step < 2000; ++Step)
+	{
+		TArray<int32> Handles;
+		Expected.GenerateKeyArray(Handles);
+
+		const int32 Action = RandomStream.RandRange(0, 2);
+		if (Action == 0 || Handles.Num() == 0)
+		{
+			const int32 PrimitiveTypeId = RandomStream.RandRange(0, 2);
+			const int32 ColorId = RandomStream.RandRange(0, 3);
+			const int32 Handle = ShapeIndex.Add(PrimitiveTypeId, ColorId);
+			if (!TestFalse(FString::Printf(TEXT("Handle %d given to a live shape at step %d"), Handle, Step), Expected.Contains(Handle)))
+			{
+				return false;
+			}
+			Expected.Add(Handle, TPair<int32, int32>(PrimitiveTypeId, ColorId));
+		}
+		else if (Action == 1)
+		{
+			const int32 Handle = Handles[RandomStream.RandRange(0, Handles.Num() - 1)];
+			ShapeIndex.Remove(Handle);
+			Expected.Remove(Handle);
+		}
+		else
+		{
+			const int32 Handle = Handles[RandomStream.RandRange(0, Handles.Num() - 1)];
+			const int32 PrimitiveTypeId = RandomStream.RandRange(0, 2);
+			const int32 ColorId = RandomStream.RandRange(0, 3);
+			ShapeIndex.Move(Handle, PrimitiveTypeId, ColorId);
+			Expected.Add(Handle, TPair<int32, int32>(PrimitiveTypeId, ColorId));
+		}
+
+		for (const TPair<int32, TPair<int32, int32>>& Shape : Expected)
+		{
+			if (!TestTrue(FString::Printf(TEXT("Handle %d valid at step %d"), Shape.Key, Step), ShapeIndex.IsValidHandle(Shape.Key))
+				|| !TestEqual(FString::Printf(TEXT("Handle %d primitive type at step %d"), Shape.Key, Step), ShapeIndex.GetPrimitiveTypeId(Shape.Key), Shape.Value.Key)
+				|| !TestEqual(FString::Printf(TEXT("Handle %d color at step %d"), Shape.Key, Step), ShapeIndex.GetColorId(Shape.Key), Shape.Value.Value))
+			{
+				return false;
+			}
+		}
+		TestEqual(FString::Printf(TEXT("Number of shapes at step %d"), Step), ShapeIndex.Num(), Expected.Num());
+	}
+
+	return true;
+}
+
+#endif
@@ -4,3 +4,9 @@
 #include "Modules/ModuleManager.h"
 
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, Shapes, "Shapes" );
+
+DEFINE_STAT(STAT_ShapesLive);
+DEFINE_STAT(STAT_ShapesPooled);
+DEFINE_STAT(STAT_ShapesColorMIDs);
+DEFINE_STAT(STAT_ShapesRebalancesPerSecond);
+DEFINE_STAT(STAT_ShapesRebalances);
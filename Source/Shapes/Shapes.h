@@ -3,4 +3,12 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
 
+DECLARE_STATS_GROUP(TEXT("Shapes"), STATGROUP_Shapes, STATCAT_Advanced);
+
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Live shapes"), STAT_ShapesLive, STATGROUP_Shapes, SHAPES_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pooled shapes"), STAT_ShapesPooled, STATGROUP_Shapes, SHAPES_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Color MIDs"), STAT_ShapesColorMIDs, STATGROUP_Shapes, SHAPES_API);
+DECLARE_FLOAT_ACCUMULATOR_STAT_EXTERN(TEXT("Rebalances per second"), STAT_ShapesRebalancesPerSecond, STATGROUP_Shapes, SHAPES_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Rebalances"), STAT_ShapesRebalances, STATGROUP_Shapes, SHAPES_API);